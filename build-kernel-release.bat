@@ -15,6 +15,7 @@ if %kernel%==0 (linkall obj/kernel bin/kernel.bin "--oformat binary -Ttext 0xFFF
 
 rem install kernel in the filesystem
 if %kernel%==0 (bin-install fs bootable\imageGPT.vhd /ptos/sys/kernel.bin bin/kernel.bin || (set /A kernel = 3))
+if %kernel%==0 (bin-install fs bootable\imageGPT.vhd /ptos/sys/ptos.map bin/ptos.map || (set /A kernel = 3))
 
 rem display errors
 if %kernel%==1 (echo "Failed to compile or assemble the kernel!")
@@ -0,0 +1,46 @@
+#include "bigpages.h"
+#include "scheduler.h"
+#include <iostream.h>
+#define OMIT_FUNCS
+#include <syscall.h>
+
+using namespace std;
+
+namespace BigPages
+{
+	ull scanCount = 0, collapsedCount = 0;
+
+	void scan()
+	{
+		// tasks can only die while interrupts are enabled
+		disableInterrupts();
+		vector<Task *> tasks;
+		Scheduler::getTasks(tasks);
+		int left = collapsesPerScan;
+		for (ull i = 0; i < tasks.getSize() && left > 0; i++)
+			left -= tasks[i]->collapseBigPages(left);
+		collapsedCount += collapsesPerScan - left;
+		scanCount++;
+		enableInterrupts();
+	}
+
+	void daemon()
+	{
+		while (true)
+		{
+			Time::sleep(scanInterval);
+			scan();
+		}
+	}
+
+	void Initialize()
+	{
+		if (Scheduler::createKernelThread(daemon) == nullptr)
+			cout << "Could not start the big page daemon\n";
+	}
+
+	void DisplaySummary()
+	{
+		cout << "Big page scans: " << scanCount << ", blocks collapsed: " << collapsedCount << '\n';
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <types.h>
+
+// background promotion of user memory to big pages: a kernel thread periodically looks for 2MB blocks
+// that were committed page by page, and maps each of them with a single big page
+namespace BigPages
+{
+	// time between two scans
+	static constexpr ull scanInterval = 1000; // ms
+	// blocks collapsed per scan at most, since a scan runs with interrupts disabled
+	static constexpr int collapsesPerScan = 4;
+
+	// start the kernel thread; interrupts have to be enabled already
+	void Initialize();
+
+	void DisplaySummary();
+}
@@ -1,5 +1,6 @@
 #include "fat32.h"
 #include "../mem.h"
+#include "../objectcache.h"
 
 using namespace Disk;
 using namespace std;
@@ -475,6 +476,10 @@ namespace Filesystem
 					advance();
 				}
 			}
+			// an iterator is made for every path lookup, its memory comes from an object cache
+			static void *operator new(size_t size);
+			static void operator delete(void *ptr, size_t size);
+
 			~DirectoryIterator()
 			{
 				if (directoryData)
@@ -650,6 +655,10 @@ namespace Filesystem
 
 			friend Partition;
 		};
+		TypedObjectCache<DirectoryIterator> directoryIteratorCache("FAT32 iterator", 16);
+		void *DirectoryIterator::operator new(size_t size) { return directoryIteratorCache.allocate(size); }
+		void DirectoryIterator::operator delete(void *ptr, size_t size) { directoryIteratorCache.deallocate(ptr, size); }
+
 		class Partition : public Filesystem::Partition
 		{
 		public:
@@ -883,6 +892,54 @@ namespace Filesystem
 				}
 			}
 
+			// read or write the part of a cluster chain that starts offset bytes into it, a cluster at a time;
+			// stops at the first error, a chain that ends before length bytes is one too
+			Disk::result AccessClusterChain(uint startCluster, ull offset, byte *buffer, ull length, Disk::accessDir dir)
+			{
+				ull clusterLen = 512 * sectorsPerCluster;
+				uint cluster = startCluster;
+				for (ull skip = offset / clusterLen; skip > 0 && cluster < lastCluster; skip--)
+					cluster = getFatEntry(cluster);
+				offset %= clusterLen;
+
+				byte *clusterData = new byte[clusterLen];
+				if (clusterData == nullptr)
+					return Disk::result::unknownError;
+				Disk::result res = Disk::result::success;
+				for (; length > 0 && cluster < lastCluster; cluster = getFatEntry(cluster))
+				{
+					ull len = clusterLen - offset;
+					if (len > length)
+						len = length;
+					// a partially written cluster keeps the rest of its contents
+					if (dir == Disk::accessDir::read || len < clusterLen)
+						res = (Disk::result)read(disk, ClusterToLba(cluster), sectorsPerCluster, clusterData);
+					if (res == Disk::result::success && dir == Disk::accessDir::read)
+						memcpy(buffer, clusterData + offset, len);
+					else if (res == Disk::result::success)
+					{
+						memcpy(clusterData + offset, buffer, len);
+						res = (Disk::result)write(disk, ClusterToLba(cluster), sectorsPerCluster, clusterData);
+					}
+					if (res != Disk::result::success)
+					{
+						cout << "Error accessing cluster " << cluster << ": " << Disk::resultAsString(res) << '\n';
+						break;
+					}
+
+					buffer += len;
+					length -= len;
+					offset = 0;
+				}
+				delete[] clusterData;
+				if (res == Disk::result::success && length > 0)
+				{
+					cout << "Cluster chain of " << startCluster << " ends " << length << " bytes early\n";
+					res = Disk::result::unknownError;
+				}
+				return res;
+			}
+
 			inline void separateParentpathFromFilepath(string16 &path, string16 &filename)
 			{
 				ull slash = path.lastOf('/');
@@ -1074,6 +1131,157 @@ namespace Filesystem
 				return res;
 			}
 
+			// find the directory entry of a file; on success, the iterator is left at the entry and has to be deleted
+			result FindFile(string16 &path, DirectoryIterator *&it)
+			{
+				string16 filename;
+				separateParentpathFromFilepath(path, filename);
+				if (path.length() == 0)
+					path = u"/";
+
+				it = GetDirectoryIterator(path);
+				if (it == nullptr)
+					return result::invalidPath;
+				it->advanceTo(filename);
+				if (it->finished())
+				{
+					delete it;
+					return result::fileDoesNotExist;
+				}
+				if (it->getStdEntry()->attributes.isAny(FileAttributes::directory | FileAttributes::volume_id))
+				{
+					delete it;
+					return result::notAFile;
+				}
+				return result::success;
+			}
+			result GetFileLength(string16 &path, ull &length) override
+			{
+				DirectoryIterator *it;
+				result res = FindFile(path, it);
+				if (res != result::success)
+					return res;
+				length = it->getStdEntry()->fileSize;
+				delete it;
+				return result::success;
+			}
+			result ReadFileRange(string16 &path, ull offset, byte *buffer, ull length) override
+			{
+				DirectoryIterator *it;
+				result res = FindFile(path, it);
+				if (res != result::success)
+					return res;
+				Standard83Entry *entry = it->getStdEntry();
+				if (offset + length > entry->fileSize)
+					length = offset < entry->fileSize ? entry->fileSize - offset : 0;
+				if (length > 0 && entry->getFirstCluster() > 1 &&
+					AccessClusterChain(entry->getFirstCluster(), offset, buffer, length, Disk::accessDir::read) != Disk::result::success)
+					res = result::diskError;
+				delete it;
+				return res;
+			}
+			result WriteFileRange(string16 &path, ull offset, byte *buffer, ull length) override
+			{
+				DirectoryIterator *it;
+				result res = FindFile(path, it);
+				if (res != result::success)
+					return res;
+				Standard83Entry *entry = it->getStdEntry();
+				if (entry->attributes.isAny(FileAttributes::readOnly))
+				{
+					delete it;
+					return result::fileIsReadOnly;
+				}
+				if (offset + length > entry->fileSize)
+					length = offset < entry->fileSize ? entry->fileSize - offset : 0;
+				if (length > 0 && entry->getFirstCluster() > 1 &&
+					AccessClusterChain(entry->getFirstCluster(), offset, buffer, length, Disk::accessDir::write) != Disk::result::success)
+					res = result::diskError;
+				delete it;
+				return res;
+			}
+			result SetFileLength(string16 &path, ull length) override
+			{
+				DirectoryIterator *it;
+				result res = FindFile(path, it);
+				if (res != result::success)
+					return res;
+				Standard83Entry *entry = it->getStdEntry();
+				if (entry->attributes.isAny(FileAttributes::readOnly))
+				{
+					delete it;
+					return result::fileIsReadOnly;
+				}
+
+				ull clusterLen = 512 * sectorsPerCluster;
+				uint firstCluster = entry->getFirstCluster(),
+					 clusterCount = firstCluster > 1 ? GetClusterChainLength(firstCluster) : 0,
+					 neededClusterCount = integerCeilDivide(length, clusterLen);
+				if (neededClusterCount > clusterCount && neededClusterCount - clusterCount > fsInfo->freeClusterCount)
+				{
+					delete it;
+					return result::partitionFull;
+				}
+				// the last cluster that is kept
+				uint last = 0;
+				for (uint cluster = firstCluster, i = 0; i < clusterCount && i < neededClusterCount; cluster = getFatEntry(cluster), i++)
+					last = cluster;
+				if (neededClusterCount < clusterCount)
+				{
+					uint cluster = last ? getFatEntry(last) : firstCluster;
+					if (last)
+						updateFatEntry(last, lastCluster);
+					else
+						entry->setFirstCluster(0);
+					while (cluster < lastCluster)
+					{
+						uint next = getFatEntry(cluster);
+						DeallocateCluster(cluster);
+						cluster = next;
+					}
+				}
+				if (length > entry->fileSize)
+				{
+					// the file grows with zeroes, a cluster at a time, so the buffer stays small whatever the length
+					byte *zeroes = new byte[clusterLen];
+					memset(zeroes, clusterLen, 0);
+					// the rest of the clusters the file already has may hold old data
+					ull end = (ull)clusterCount * clusterLen < length ? (ull)clusterCount * clusterLen : length;
+					for (ull offset = entry->fileSize; offset < end && res == result::success; offset += clusterLen - offset % clusterLen)
+					{
+						ull len = clusterLen - offset % clusterLen < end - offset ? clusterLen - offset % clusterLen : end - offset;
+						if (AccessClusterChain(firstCluster, offset, zeroes, len, Disk::accessDir::write) != Disk::result::success)
+							res = result::diskError;
+					}
+					uint chainLength = clusterCount;
+					for (; chainLength < neededClusterCount && res == result::success; chainLength++)
+					{
+						uint cluster = AllocateCluster();
+						if ((Disk::result)write(disk, ClusterToLba(cluster), sectorsPerCluster, zeroes) != Disk::result::success)
+						{
+							DeallocateCluster(cluster);
+							res = result::diskError;
+							break;
+						}
+						updateFatEntry(cluster, lastCluster);
+						if (last)
+							updateFatEntry(last, cluster);
+						else
+							entry->setFirstCluster(cluster);
+						last = cluster;
+					}
+					delete[] zeroes;
+					flushFSInfo();
+					// the file keeps the clusters that were zeroed before the error
+					if (res != result::success)
+						length = chainLength > clusterCount ? (ull)chainLength * clusterLen : entry->fileSize;
+				}
+				entry->fileSize = length;
+				it->flush();
+				delete it;
+				return res;
+			}
+
 			DirectoryIterator *GetDirectoryIterator(string16 &path) override
 			{
 				if (path[0] != u'/')
@@ -1,5 +1,9 @@
 #include "filesystem.h"
 #include "fat32.h"
+#include "../task.h"
+#include "../scheduler.h"
+#define OMIT_FUNCS
+#include <syscall.h>
 
 // #include "sys.h"
 #include "mem.h"
@@ -14,6 +18,35 @@ namespace Filesystem
 
 	vector<Partition *> *partitions;
 
+	// one thread at a time gets to the partitions: the disk drivers only keep track of a single thread waiting for
+	// a command, and the partitions cache sectors of their own; the thread that holds the lock can take it again
+	Thread *lockOwner = nullptr;
+	ull lockDepth = 0;
+	void lock()
+	{
+		Thread *thread = Scheduler::getCurrentThread();
+		while (true)
+		{
+			disableInterrupts();
+			if (lockOwner == nullptr || lockOwner == thread)
+			{
+				lockOwner = thread;
+				lockDepth++;
+				enableInterrupts();
+				return;
+			}
+			enableInterrupts();
+			Time::sleep(1);
+		}
+	}
+	void unlock()
+	{
+		disableInterrupts();
+		if (--lockDepth == 0)
+			lockOwner = nullptr;
+		enableInterrupts();
+	}
+
 	void Initialize()
 	{
 		partitions = new vector<Partition *>();
@@ -60,7 +93,10 @@ namespace Filesystem
 			return result::invalidPartition;
 
 		string16 path_copy(path.data() + 2);
-		return part->CreateFile(path_copy, contents, length);
+		lock();
+		result res = part->CreateFile(path_copy, contents, length);
+		unlock();
+		return res;
 	}
 	result RemoveFile(const string16 &path)
 	{
@@ -71,8 +107,13 @@ namespace Filesystem
 		if (part == nullptr)
 			return result::invalidPartition;
 
+		// a loaded program may be the one changing
+		Task::forgetTemplates();
 		string16 path_copy(path.data() + 2);
-		return part->RemoveFile(path_copy);
+		lock();
+		result res = part->RemoveFile(path_copy);
+		unlock();
+		return res;
 	}
 
 	result ReadFile(const string16 &path, byte *&contents, ull &length)
@@ -85,7 +126,10 @@ namespace Filesystem
 			return result::invalidPartition;
 
 		string16 path_copy(path.data() + 2);
-		return part->ReadFile(path_copy, contents, length);
+		lock();
+		result res = part->ReadFile(path_copy, contents, length);
+		unlock();
+		return res;
 	}
 	result WriteFile(const string16 &path, byte *contents, ull length)
 	{
@@ -96,8 +140,76 @@ namespace Filesystem
 		if (part == nullptr)
 			return result::invalidPartition;
 
+		Task::forgetTemplates();
+		string16 path_copy(path.data() + 2);
+		lock();
+		result res = part->WriteFile(path_copy, contents, length);
+		unlock();
+		return res;
+	}
+
+	result GetFileLength(const string16 &path, ull &length)
+	{
+		if (path.length() > 1 && path[1] != ':')
+			return result::invalidPath;
+
+		auto part = getPartition(toLower(path[0]));
+		if (part == nullptr)
+			return result::invalidPartition;
+
+		string16 path_copy(path.data() + 2);
+		lock();
+		result res = part->GetFileLength(path_copy, length);
+		unlock();
+		return res;
+	}
+	result ReadFileRange(const string16 &path, ull offset, byte *buffer, ull length)
+	{
+		if (path.length() > 1 && path[1] != ':')
+			return result::invalidPath;
+
+		auto part = getPartition(toLower(path[0]));
+		if (part == nullptr)
+			return result::invalidPartition;
+
+		string16 path_copy(path.data() + 2);
+		lock();
+		result res = part->ReadFileRange(path_copy, offset, buffer, length);
+		unlock();
+		return res;
+	}
+	result WriteFileRange(const string16 &path, ull offset, byte *buffer, ull length)
+	{
+		if (path.length() > 1 && path[1] != ':')
+			return result::invalidPath;
+
+		auto part = getPartition(toLower(path[0]));
+		if (part == nullptr)
+			return result::invalidPartition;
+
+		// unlike WriteFile, the loaded programs are kept: this runs on the pager thread, which must not race with createTask
+		string16 path_copy(path.data() + 2);
+		lock();
+		result res = part->WriteFileRange(path_copy, offset, buffer, length);
+		unlock();
+		return res;
+	}
+
+	result SetFileLength(const string16 &path, ull length)
+	{
+		if (path.length() > 1 && path[1] != ':')
+			return result::invalidPath;
+
+		auto part = getPartition(toLower(path[0]));
+		if (part == nullptr)
+			return result::invalidPartition;
+
+		Task::forgetTemplates();
 		string16 path_copy(path.data() + 2);
-		return part->WriteFile(path_copy, contents, length);
+		lock();
+		result res = part->SetFileLength(path_copy, length);
+		unlock();
+		return res;
 	}
 
 	DirectoryIterator *GetDirectoryIterator(const string16 &path)
@@ -110,7 +222,10 @@ namespace Filesystem
 			return nullptr;
 
 		string16 path_copy(path.data() + 2);
-		return part->GetDirectoryIterator(path_copy);
+		lock();
+		DirectoryIterator *iterator = part->GetDirectoryIterator(path_copy);
+		unlock();
+		return iterator;
 	}
 	result RemoveDirectory(const string16 &path)
 	{
@@ -122,7 +237,10 @@ namespace Filesystem
 			return result::invalidPartition;
 
 		string16 path_copy(path.data() + 2);
-		return part->RemoveDirectory(path_copy);
+		lock();
+		result res = part->RemoveDirectory(path_copy);
+		unlock();
+		return res;
 	}
 	result CreateDirectory(const string16 &path)
 	{
@@ -134,7 +252,10 @@ namespace Filesystem
 			return result::invalidPartition;
 
 		string16 path_copy(path.data() + 2);
-		return part->CreateDirectory(path_copy);
+		lock();
+		result res = part->CreateDirectory(path_copy);
+		unlock();
+		return res;
 	}
 
 	result Move(const string16 &src, const string16 &dest)
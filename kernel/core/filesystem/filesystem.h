@@ -19,7 +19,8 @@ namespace Filesystem
 		partitionFull,
 		fileIsReadOnly,
 		nameNotUnique,
-		nameTooLong
+		nameTooLong,
+		diskError
 	};
 	inline std::string resultAsString(result res)
 	{
@@ -51,6 +52,8 @@ namespace Filesystem
 			return "name not unique";
 		case result::nameTooLong:
 			return "name too long";
+		case result::diskError:
+			return "disk error";
 		}
 		return "unknown";
 	}
@@ -121,6 +124,13 @@ namespace Filesystem
 		virtual result ReadFile(std::string16 &path, byte *&contents, ull &length) = 0;
 		virtual result WriteFile(std::string16 &path, byte *contents, ull length) = 0;
 
+		// access part of a file without reading all of it; ranges are cut at the end of the file, which keeps its size
+		virtual result GetFileLength(std::string16 &path, ull &length) = 0;
+		virtual result ReadFileRange(std::string16 &path, ull offset, byte *buffer, ull length) = 0;
+		virtual result WriteFileRange(std::string16 &path, ull offset, byte *buffer, ull length) = 0;
+		// truncate a file, or make it longer by adding zeroes
+		virtual result SetFileLength(std::string16 &path, ull length) = 0;
+
 		virtual DirectoryIterator *GetDirectoryIterator(std::string16 &path) = 0;
 		virtual result RemoveDirectory(std::string16 &path) = 0;
 		virtual result CreateDirectory(std::string16 &path) = 0;
@@ -136,12 +146,18 @@ namespace Filesystem
 
 	void formatPartition(char driveLetter);
 
+	// the functions below are only for threads; they wait while another thread is using the partitions
 	result CreateFile(const std::string16 &path, byte *contents = nullptr, ull length = 0);
 	result RemoveFile(const std::string16 &path);
 
 	result ReadFile(const std::string16 &path, byte *&contents, ull &length);
 	result WriteFile(const std::string16 &path, byte *contents, ull length);
 
+	result GetFileLength(const std::string16 &path, ull &length);
+	result ReadFileRange(const std::string16 &path, ull offset, byte *buffer, ull length);
+	result WriteFileRange(const std::string16 &path, ull offset, byte *buffer, ull length);
+	result SetFileLength(const std::string16 &path, ull length);
+
 	DirectoryIterator *GetDirectoryIterator(const std::string16 &path);
 	result RemoveDirectory(const std::string16 &path);
 	result CreateDirectory(const std::string16 &path);
@@ -0,0 +1,372 @@
+#include "pagecache.h"
+#include "../scheduler.h"
+#include "../pageframe.h"
+#include "../mem.h"
+#include "../swap.h"
+#include "../shrinker.h"
+#include "../../utils/time.h"
+#include <iostream.h>
+#define OMIT_FUNCS
+#include <syscall.h>
+
+using namespace std;
+
+namespace Filesystem
+{
+	namespace PageCache
+	{
+		class Request
+		{
+		public:
+			enum class Type : byte
+			{
+				readPage,
+				mapFile,
+				swapIn,
+			};
+
+			Type type;
+			// the blocked thread
+			Thread *thread;
+			// for readPage
+			File *file;
+			ull index;
+			// for mapFile
+			char16_t path[maxPathLength];
+			ull pathLength;
+			qword offset, length;
+			// for swapIn
+			qword address;
+		};
+
+		// files with at least one mapping, or with pages that were not written back yet
+		vector<File *> *files;
+		// a ring of pending requests; only accessed with interrupts disabled
+		Request *requests;
+		word firstRequest = 0, requestCount = 0;
+		Thread *pager = nullptr;
+		ull pagesRead = 0, pagesWritten = 0, pagesReclaimed = 0;
+
+		// regs are only used by unblockThread when the cpu is idle, which it is not while the pager runs
+		void wakeUp(Thread *thread)
+		{
+			registers_t regs;
+			Scheduler::unblockThread(regs, pager, thread);
+		}
+
+		File *Open(const string16 &path, result &res)
+		{
+			disableInterrupts();
+			for (File *file : *files)
+				if (file->path == path)
+				{
+					file->mapCount++;
+					enableInterrupts();
+					res = result::success;
+					return file;
+				}
+			enableInterrupts();
+
+			ull length;
+			res = GetFileLength(path, length);
+			if (res != result::success)
+				return nullptr;
+
+			File *file = new File();
+			file->path = path;
+			file->length = length;
+			file->pageCount = integerCeilDivide(length, PageFrame::frameSize);
+			file->pages = new byte *[file->pageCount];
+			file->dirty = new bool[file->pageCount];
+			for (ull i = 0; i < file->pageCount; i++)
+			{
+				file->pages[i] = nullptr;
+				file->dirty[i] = false;
+			}
+			file->mapCount = 1;
+
+			disableInterrupts();
+			files->push_back(file);
+			enableInterrupts();
+			return file;
+		}
+		void AddReference(File *file) { file->mapCount++; }
+		void Close(File *file) { file->mapCount--; }
+
+		// the slot after the last request, filled in by the caller; nullptr if the pager is not running or the ring is full
+		Request *addRequest(Request::Type type)
+		{
+			if (pager == nullptr || requestCount == maxRequestCount)
+				return nullptr;
+			Request *request = &requests[(firstRequest + requestCount++) % maxRequestCount];
+			request->type = type;
+			request->thread = Scheduler::getCurrentThread();
+			return request;
+		}
+		bool RequestPage(registers_t &regs, File *file, ull index)
+		{
+			Request *request = addRequest(Request::Type::readPage);
+			if (request == nullptr)
+				return false;
+			request->file = file;
+			request->index = index;
+			return Scheduler::waitForThread(regs, pager);
+		}
+		bool RequestSwapIn(registers_t &regs, qword address)
+		{
+			if (!Swap::isEnabled())
+				return false;
+			Request *request = addRequest(Request::Type::swapIn);
+			if (request == nullptr)
+				return false;
+			request->address = address;
+			return Scheduler::waitForThread(regs, pager);
+		}
+		bool RequestMap(registers_t &regs, const char16_t *path, ull pathLength, qword offset, qword length)
+		{
+			if (pathLength > maxPathLength)
+				return false;
+			Request *request = addRequest(Request::Type::mapFile);
+			if (request == nullptr)
+				return false;
+			memcpy(request->path, path, pathLength * sizeof(char16_t));
+			request->pathLength = pathLength;
+			request->offset = offset;
+			request->length = length;
+			return Scheduler::waitForThread(regs, pager);
+		}
+
+		void serveReadPage(Request &request)
+		{
+			File *file = request.file;
+			// read the missing pages that follow too, with a single lookup of the file
+			ull count = 0;
+			while (count < readAheadPages && request.index + count < file->pageCount && file->pages[request.index + count] == nullptr)
+				count++;
+
+			bool success = true;
+			if (count > 0)
+			{
+				// the end of the last page of the file is zero filled
+				byte *buffer = new byte[count * PageFrame::frameSize];
+				memset(buffer, count * PageFrame::frameSize, 0);
+				result res = ReadFileRange(file->path, request.index * PageFrame::frameSize, buffer, count * PageFrame::frameSize);
+				if (res != result::success)
+				{
+					cout << "Could not read a mapped file: " << resultAsString(res) << '\n';
+					success = false;
+				}
+				for (ull i = 0; i < count && success; i++)
+				{
+					byte *frame = (byte *)PageFrame::Allocate();
+					if (frame == nullptr)
+					{
+						success = false;
+						break;
+					}
+					memcpy(frame, buffer + i * PageFrame::frameSize, PageFrame::frameSize);
+
+					disableInterrupts();
+					file->pages[request.index + i] = frame;
+					pagesRead++;
+					enableInterrupts();
+				}
+				delete[] buffer;
+			}
+
+			disableInterrupts();
+			// otherwise the thread would fault on the same page again
+			if (!success && file->pages[request.index] == nullptr)
+				Scheduler::kill(request.thread->getParentTask(), -1);
+			wakeUp(request.thread);
+			enableInterrupts();
+		}
+		void serveMapFile(Request &request)
+		{
+			result res;
+			string16 path;
+			path.assign(request.path, request.pathLength);
+			File *file = Open(path, res);
+
+			disableInterrupts();
+			Task *task = request.thread->getParentTask();
+			qword address = 0;
+			if (file && (task->isDead() || !task->mapFile(file, request.offset, request.length, address)))
+			{
+				Close(file);
+				address = 0;
+			}
+			request.thread->getRegs().rax = address;
+			wakeUp(request.thread);
+			enableInterrupts();
+		}
+
+		void serveSwapIn(Request &request)
+		{
+			bool success = Swap::SwapIn(request.thread->getParentTask(), request.address);
+
+			disableInterrupts();
+			// otherwise the thread would fault on the same page again
+			if (!success)
+				Scheduler::kill(request.thread->getParentTask(), -1);
+			wakeUp(request.thread);
+			enableInterrupts();
+		}
+
+		void writeBack()
+		{
+			// move the dirty bits of the page tables to the files
+			disableInterrupts();
+			vector<Task *> tasks;
+			Scheduler::getTasks(tasks);
+			for (Task *task : tasks)
+				task->collectDirtyPages();
+			enableInterrupts();
+
+			// only the pager removes files from the list
+			for (ull i = 0; i < files->getSize(); i++)
+			{
+				File *file = files->at(i);
+				for (ull page = 0; page < file->pageCount; page++)
+				{
+					if (!file->dirty[page])
+						continue;
+					// cleared first, so that a write that comes after this one is not lost;
+					// the write allocates, and the shrinker it may run must not take the clean page while it is written
+					byte *frame = file->pages[page];
+					disableInterrupts();
+					file->dirty[page] = false;
+					// a frame that cannot take the pin has more owners than the shrinker would ever take
+					bool pinned = PageFrame::Share(frame);
+					enableInterrupts();
+					qword offset = page * PageFrame::frameSize;
+					result res = WriteFileRange(file->path, offset, frame, PageFrame::frameSize);
+					disableInterrupts();
+					// drops the pin
+					if (pinned)
+						PageFrame::Deallocate(frame);
+					// the page is the only copy of the data, it must not look clean
+					if (res != result::success)
+						file->dirty[page] = true;
+					enableInterrupts();
+					if (res != result::success)
+					{
+						cout << "Could not write back a mapped file: " << resultAsString(res) << '\n';
+						continue;
+					}
+					pagesWritten++;
+				}
+
+				disableInterrupts();
+				bool dirty = false;
+				for (ull page = 0; page < file->pageCount && !dirty; page++)
+					dirty = file->dirty[page];
+				if (file->mapCount == 0 && !dirty)
+				{
+					for (ull page = 0; page < file->pageCount; page++)
+						if (file->pages[page])
+							PageFrame::Deallocate(file->pages[page]);
+					delete[] file->pages;
+					delete[] file->dirty;
+					delete file;
+					files->erase(i--);
+				}
+				enableInterrupts();
+			}
+		}
+
+		void pagerMain()
+		{
+			Swap::Initialize();
+			qword lastWriteBack = Time::driver_time();
+			while (true)
+			{
+				disableInterrupts();
+				bool pending = requestCount > 0;
+				Request request;
+				if (pending)
+				{
+					request = requests[firstRequest];
+					firstRequest = (firstRequest + 1) % maxRequestCount;
+					requestCount--;
+				}
+				enableInterrupts();
+
+				if (pending)
+				{
+					if (request.type == Request::Type::readPage)
+						serveReadPage(request);
+					else if (request.type == Request::Type::swapIn)
+						serveSwapIn(request);
+					else
+						serveMapFile(request);
+					continue;
+				}
+				if (Swap::isMemoryLow())
+					Swap::Reclaim();
+				if (Time::driver_time() - lastWriteBack >= writeBackInterval)
+				{
+					writeBack();
+					lastWriteBack = Time::driver_time();
+				}
+				Time::sleep(requestInterval);
+			}
+		}
+
+		// pages that only the cache holds and that were written back can be read again when needed
+		// a shared frame is mapped by a task, or pinned while the pager writes it
+		inline bool isReclaimable(File *file, ull page)
+		{
+			return file->pages[page] && !file->dirty[page] && !PageFrame::isShared(file->pages[page]);
+		}
+		ull countReclaimable()
+		{
+			ull count = 0;
+			for (File *file : *files)
+				for (ull page = 0; page < file->pageCount; page++)
+					count += isReclaimable(file, page);
+			return count;
+		}
+		// the files themselves stay in the list, the pager drops them once they are closed
+		ull reclaimPages(ull count)
+		{
+			ull freed = 0;
+			for (ull i = 0; i < files->getSize() && freed < count; i++)
+			{
+				File *file = files->at(i);
+				for (ull page = 0; page < file->pageCount && freed < count; page++)
+					if (isReclaimable(file, page))
+					{
+						PageFrame::Deallocate(file->pages[page]);
+						file->pages[page] = nullptr;
+						freed++;
+						pagesReclaimed++;
+					}
+			}
+			return freed;
+		}
+
+		void Initialize()
+		{
+			files = new vector<File *>();
+			requests = new Request[maxRequestCount];
+			Shrinker::Register(Shrinker::Shrinker{"Page cache", countReclaimable, reclaimPages, PageFrame::frameSize});
+			pager = Scheduler::createKernelThread(pagerMain);
+			if (pager == nullptr)
+				cout << "Could not start the pager\n";
+		}
+
+		void DisplaySummary()
+		{
+			ull loaded = 0, dirty = 0;
+			for (File *file : *files)
+				for (ull page = 0; page < file->pageCount; page++)
+				{
+					loaded += file->pages[page] != nullptr;
+					dirty += file->dirty[page];
+				}
+			cout << "Cached files: " << files->getSize() << ", pages loaded: " << loaded << ", dirty: " << dirty << '\n';
+			cout << "Pages read: " << pagesRead << ", written back: " << pagesWritten << ", reclaimed: " << pagesReclaimed << '\n';
+		}
+	}
+}
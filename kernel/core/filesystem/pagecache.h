@@ -0,0 +1,55 @@
+#pragma once
+#include "filesystem.h"
+
+namespace Filesystem
+{
+	// pages of the files that tasks map into their address space; every task mapping a file shares the same frames
+	// the disk can only be accessed from a thread, so the pages are read and written back by a kernel thread, the pager:
+	// a task that touches a page that was not read yet is blocked until the pager read it
+	// the pager also moves pages between memory and the swap file
+	namespace PageCache
+	{
+		class File
+		{
+		public:
+			std::string16 path;
+			ull length, pageCount;
+			// one frame per page, nullptr until the page is read
+			byte **pages;
+			// set for the pages changed since they were last written back
+			bool *dirty;
+			// mappings of the file; it is written back and dropped once there are none
+			int mapCount;
+		};
+
+		// pages read at most for a single fault
+		static constexpr ull readAheadPages = 8;
+		// requests are queued from interrupt handlers, which must not allocate, so the queue has a fixed size;
+		// a thread waits for its own request only, so this is the number of threads that can wait at once
+		static constexpr word maxRequestCount = 64;
+		static constexpr ull maxPathLength = 256;
+		// how often the pager checks for requests, and writes back the changed pages
+		static constexpr ull requestInterval = 10,	 // ms
+							 writeBackInterval = 1000; // ms
+
+		// start the pager; interrupts have to be enabled already
+		void Initialize();
+
+		// only from a thread: get the cached file, or read its length if it is not cached yet; adds a mapping to it
+		File *Open(const std::string16 &path, result &res);
+		// add a mapping to a file that is already open
+		void AddReference(File *file);
+		// remove a mapping; the pager writes back the file and drops it when there are none left
+		void Close(File *file);
+
+		// the requests return false if the pager is not running or its queue is full
+		// block the current thread until the pager read a page of the file; the task is killed if the page cannot be read
+		bool RequestPage(registers_t &regs, File *file, ull index);
+		// block the current thread until the pager read back its swapped out page containing address
+		bool RequestSwapIn(registers_t &regs, qword address);
+		// block the current thread until the pager mapped the file into its task; rax is set to the address, or 0
+		bool RequestMap(registers_t &regs, const char16_t *path, ull pathLength, qword offset, qword length);
+
+		void DisplaySummary();
+	}
+}
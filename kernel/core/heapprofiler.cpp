@@ -0,0 +1,162 @@
+#include "heapprofiler.h"
+#include "filesystem/filesystem.h"
+#include "../utils/time.h"
+#include <iostream.h>
+#include <mem.h>
+#define OMIT_FUNCS
+#include <syscall.h>
+
+using namespace std;
+
+namespace HeapProfiler
+{
+	class Site
+	{
+	public:
+		Memory::Heap::SiteStatistics stats;
+		ull recentAllocations;
+		// the closest address below the site that the map names
+		qword symbol;
+		string name;
+	};
+
+	// allocation counts at the previous report, by index in the site table of the heap
+	ull previousAllocations[Memory::Heap::siteTableSize];
+	qword previousTime = 0;
+
+	inline bool isHexDigit(char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+	inline qword hexDigitValue(char c) { return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10; }
+
+	// a line of the map names an address either as "0x<address> <symbol>", or as "<.text section> 0x<address> 0x<size> <object file>",
+	// where the section can be on the line before; the site is in the function of the closest name below it
+	void resolveSites(const char *map, ull length, vector<Site> &sites)
+	{
+		for (ull start = 0, end = 0; start < length; start = end + 1)
+		{
+			end = start;
+			while (end < length && map[end] != '\n')
+				end++;
+			ull lineEnd = end;
+			while (lineEnd > start && (map[lineEnd - 1] == '\r' || map[lineEnd - 1] == ' '))
+				lineEnd--;
+
+			ull i = start;
+			while (i < lineEnd && map[i] == ' ')
+				i++;
+			if (i < lineEnd && map[i] == '.')
+			{
+				// only code sections can contain a call site
+				if (lineEnd - i < 5 || map[i + 1] != 't' || map[i + 2] != 'e' || map[i + 3] != 'x' || map[i + 4] != 't')
+					continue;
+				while (i < lineEnd && map[i] != ' ')
+					i++;
+				while (i < lineEnd && map[i] == ' ')
+					i++;
+			}
+			if (i + 2 >= lineEnd || map[i] != '0' || map[i + 1] != 'x')
+				continue;
+
+			qword address = 0;
+			for (i += 2; i < lineEnd && isHexDigit(map[i]); i++)
+				address = address << 4 | hexDigitValue(map[i]);
+			while (i < lineEnd && map[i] == ' ')
+				i++;
+			if (i + 1 < lineEnd && map[i] == '0' && map[i + 1] == 'x')
+			{
+				// the size of an input section, the object file comes after it
+				while (i < lineEnd && map[i] != ' ')
+					i++;
+				while (i < lineEnd && map[i] == ' ')
+					i++;
+			}
+			// assignments of the linker script are not names
+			bool isName = i < lineEnd && address != 0;
+			for (ull j = i; j < lineEnd && isName; j++)
+				isName = map[j] != '=';
+			if (!isName)
+				continue;
+
+			for (Site &site : sites)
+				if (address <= site.stats.site && address > site.symbol)
+				{
+					site.symbol = address;
+					site.name = string(map + i, lineEnd - i);
+				}
+		}
+	}
+
+	bool readMap(const string16 &path, vector<Site> &sites)
+	{
+		byte *contents;
+		ull length;
+		if (path.length() > 0)
+		{
+			if (Filesystem::ReadFile(path, contents, length) != Filesystem::result::success)
+				return false;
+		}
+		else
+		{
+			string letters = Filesystem::partitionList();
+			ull i = 0;
+			for (; i < letters.length(); i++)
+				if (Filesystem::ReadFile((char16_t)letters[i] + string16(mapPath), contents, length) == Filesystem::result::success)
+					break;
+			if (i == letters.length())
+				return false;
+		}
+		resolveSites((const char *)contents, length, sites);
+		delete[] contents;
+		return true;
+	}
+
+	void DisplaySites(const string16 &path)
+	{
+		if (!Memory::selectedHeap->isProfiled())
+		{
+			cout << "The heap does not record its callers\n";
+			return;
+		}
+		// copied first, since reading the map allocates too
+		vector<Site> sites;
+		disableInterrupts();
+		qword now = Time::driver_time(), elapsed = now - previousTime;
+		ull untracked = Memory::selectedHeap->getUntrackedAllocations();
+		Memory::Heap::SiteStatistics stats[Memory::Heap::siteTableSize];
+		for (word i = 0; i < Memory::Heap::siteTableSize; i++)
+			stats[i] = Memory::selectedHeap->getSiteStatistics(i);
+		enableInterrupts();
+
+		for (word i = 0; i < Memory::Heap::siteTableSize; i++)
+		{
+			if (stats[i].site == 0)
+				continue;
+			sites.push_back(Site{stats[i], stats[i].allocations - previousAllocations[i], 0, string()});
+			previousAllocations[i] = stats[i].allocations;
+		}
+		previousTime = now;
+
+		if (!readMap(path, sites))
+			cout << "Could not read the linker map, showing addresses only\n";
+
+		// the sites holding the most memory first
+		for (ull i = 1; i < sites.getSize(); i++)
+			for (ull j = i; j > 0 && sites[j - 1].stats.liveBytes < sites[j].stats.liveBytes; j--)
+			{
+				Site site = sites[j];
+				sites[j] = sites[j - 1];
+				sites[j - 1] = site;
+			}
+
+		cout << "Live bytes | Live | Allocations | Per second | Site\n";
+		for (Site &site : sites)
+		{
+			cout << site.stats.liveBytes << "\t| " << site.stats.liveObjects << "\t| " << site.stats.allocations << "\t| "
+				 << (elapsed ? site.recentAllocations * 1000 / elapsed : 0) << "\t| " << (void *)site.stats.site;
+			if (site.symbol)
+				cout << ' ' << site.name << " + " << ostream::base::hex << site.stats.site - site.symbol << ostream::base::dec;
+			cout << '\n';
+		}
+		if (untracked)
+			cout << untracked << " allocations from sites past the first " << Memory::Heap::siteTableSize << '\n';
+	}
+}
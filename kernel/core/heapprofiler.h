@@ -0,0 +1,13 @@
+#pragma once
+#include <string.h>
+
+// the kernel heap records the caller of every malloc and new; this reports the callers, named after the
+// functions they are in according to the linker map that the build installs next to the kernel
+namespace HeapProfiler
+{
+	static constexpr char16_t mapPath[] = u":/ptos/sys/ptos.map";
+
+	// live bytes, live allocations and allocations per second since the last report, for every call site;
+	// with an empty path, the map is looked for on every partition
+	void DisplaySites(const std::string16 &path);
+}
@@ -3,15 +3,14 @@
 
 [section .text]
 
+[extern idleWork]
+
+; runs whenever there is no thread to execute, with interrupts enabled
+; background work is done first, then the cpu halts until the next interrupt
 global idleTask
 idleTask:
+call idleWork
+test al, al
+jnz idleTask
 hlt
-mov rax, 1
-mov rax, 2
-lea rdi, [afterhltmsg]
-here:
-jmp here
-
-[section .data]
-afterhltmsg:
-db "After hlt", 10, 0
\ No newline at end of file
+jmp idleTask
@@ -1,14 +1,16 @@
 #include "mem.h"
 #include <iostream.h>
 #include "paging.h"
+#include "pageframe.h"
 #include "../cpu/interrupt/idt.h"
 #include "sys.h"
 #include "../debug/verbose.h"
+#include "../cpu/cpuid.h"
+#include "../drivers/acpi/srat.h"
+#include "shrinker.h"
 
 using namespace std;
 
-extern PageMapLevel4 *kernelPaging;
-
 namespace Memory
 {
 	enum class RegionType : uint32_t
@@ -42,6 +44,48 @@ namespace Memory
 	void *pageSpace;
 	dword pageAllocationMap;
 
+	// the heap is carved out of the page frame allocator, and grows from it in blocks of at least heapGrowSize
+	static constexpr qword initialHeapSize = 0x1000000,
+						   heapGrowSize = 0x1000000;
+	static constexpr qword cr4GlobalPagesBit = 1 << 7;
+	static constexpr dword cpuidGigabytePagesBit = 1 << 26; // cpuid 0x80000001, edx
+
+	void *requestHeapMemory(qword &size)
+	{
+		qword len = size < heapGrowSize ? heapGrowSize : size;
+		void *block = PageFrame::AllocateRange(len);
+		if (block == nullptr && len != size)
+		{
+			// memory is getting low, take only what is needed
+			len = size;
+			block = PageFrame::AllocateRange(len);
+		}
+		if (block != nullptr)
+			size = alignValueUpwards(len, PageFrame::frameSize);
+		return block;
+	}
+	void releaseHeapMemory(void *address, qword size)
+	{
+		PageFrame::DeallocateRange(address, size);
+	}
+	// the kernel runs on the bootstrap processor only, so every caller is cpu 0;
+	// with interrupts disabled, nothing else can take the magazines of the cpu in the middle of an exchange
+	qword enterHeapCPU(byte &cpu)
+	{
+		cpu = 0;
+		return saveAndDisableInterrupts();
+	}
+	void leaveHeapCPU(qword state)
+	{
+		restoreInterrupts(state);
+	}
+	// interrupt handlers allocate too, so a thread keeps them out while it is inside the heap
+	qword lockHeap() { return saveAndDisableInterrupts(); }
+	ull countDepotBytes() { return selectedHeap->getDepotBytes(); }
+	ull drainDepot(ull count) { return selectedHeap->drainDepot(count); }
+	ull countEmptyArenaBytes() { return selectedHeap->getEmptyArenaBytes(); }
+	ull releaseEmptyArena(ull count) { return selectedHeap->releaseEmptyArena(); }
+
 	byte mapLength, mapEntrySize;
 	class MapEntry
 	{
@@ -164,6 +208,13 @@ namespace Memory
 		// page map them
 	}
 
+	// a range the page frame allocator refuses is lost, so it is reported
+	void addZone(qword start, qword end, qword reserved, byte node)
+	{
+		if (end > start && !PageFrame::AddZone(start, end - start, reserved, node))
+			cout << "Warning: " << (end - start) / 1024 << "KB of RAM at " << (void *)start << " could not be used\n";
+	}
+
 	void DisplayMap()
 	{
 		cout << "Memory map: (" << mapLength << " x " << mapEntrySize << " bytes): ";
@@ -222,6 +273,8 @@ namespace Memory
 	}
 	void Initialize(byte *kernelPhysicalAddress, byte *mapEntryDescriptor, byte *mapEntries)
 	{
+		SelectCopyRoutines();
+
 		VERBOSE_LOG("Processing Memory map...\n");
 		mapLength = *mapEntryDescriptor;
 		mapEntrySize = *(mapEntryDescriptor + 1);
@@ -244,6 +297,15 @@ namespace Memory
 		// pageAllocationMap = 0xffff0000;
 		bool mappingFailed = false;
 
+		// the identity map uses 1GB pages where it is aligned, if the cpu has them
+		dword eax, ebx, ecx, edx;
+		cpuid(0x80000000, eax, ebx, ecx, edx);
+		if (eax >= 0x80000001)
+			cpuid(0x80000001, eax, ebx, ecx, edx);
+		else
+			edx = 0;
+		PageDirectoryPointerTable::bigPagesEnabled = edx & cpuidGigabytePagesBit;
+
 		// create the pml4
 		PageMapLevel4 *pml4 = PageMapLevel4::create(pageSpace, pageAllocationMap);
 		if (pml4 == nullptr)
@@ -254,7 +316,9 @@ namespace Memory
 			mappingFailed = true;
 
 		// map gdt, idt, 64-bit TSS, kernel stack and kernel image
-		if (!pml4->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80000000, 0x0000, 0x80000, PageEntry::EntryAttributes(PageEntry::writeAccessBit)))
+		// the upper half is shared by every address space, so its pages are global; the identity map is not,
+		// since user tasks map their own pages in the lower half
+		if (!pml4->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80000000, 0x0000, 0x80000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::globalPageBit)))
 			mappingFailed = true;
 
 		// apply virtual map
@@ -269,31 +333,108 @@ namespace Memory
 			if (!pml4->mapRegion(pageSpace, pageAllocationMap, 0x200000, 0x200000, leftToMap, PageEntry::EntryAttributes(PageEntry::writeAccessBit)))
 				mappingFailed = true;
 
-		entry.base_address += pageSpaceLen;
-		entry.length -= pageSpaceLen;
-		
+		// the tables are reachable now that all of RAM is mapped
+		VERBOSE_LOG("Reading NUMA nodes...\n");
+		ACPI::InitializeSRAT();
+
+		// hand all usable RAM to the page frame allocator; the initial paging structures stay allocated
+		// a region is split where its NUMA node changes, so that every zone belongs to a single node
+		VERBOSE_LOG("Initializing the page frame allocator...\n");
+		// pieces that touch and belong to the same node are merged, the zone table has few entries
+		qword zoneStart = 0, zoneEnd = 0, zoneReserved = 0;
+		byte zoneNode = 0;
+		for (byte j = 0; j < mapLength; j++)
+		{
+			MapEntry &region = memoryMap[j];
+			if (region.type != RegionType::usable || region.base_address == 0x0)
+				continue;
+			qword start = (qword)region.base_address, end = start + region.length,
+				  reserved = &region == &entry ? pageSpaceLen : 0;
+			while (start < end)
+			{
+				// memory that the SRAT does not list goes to the first node
+				byte node = 0;
+				qword pieceEnd;
+				ACPI::getMemoryNode(start, node, pieceEnd);
+				if (pieceEnd > end)
+					pieceEnd = end;
+				// the reserved part has to be at the start of its zone
+				if (start != zoneEnd || node != zoneNode || reserved)
+				{
+					addZone(zoneStart, zoneEnd, zoneReserved, zoneNode);
+					zoneStart = start;
+					zoneNode = node;
+					zoneReserved = reserved;
+				}
+				zoneEnd = pieceEnd;
+				reserved = reserved > pieceEnd - start ? reserved - (pieceEnd - start) : 0;
+				start = pieceEnd;
+			}
+		}
+		addZone(zoneStart, zoneEnd, zoneReserved, zoneNode);
+		if (ACPI::getNodeCount() > 1)
+		{
+			// the kernel only runs on the bootstrap processor, so its node is the one to prefer
+			dword eax, ebx, ecx, edx;
+			cpuid(1, eax, ebx, ecx, edx);
+			byte local = ACPI::getProcessorNode(ebx >> 24);
+
+			// the other nodes from the nearest to the farthest
+			byte order[PageFrame::maxNodeCount], count = 0;
+			order[count++] = local;
+			for (byte node = 0; node < ACPI::getNodeCount(); node++)
+			{
+				if (node == local)
+					continue;
+				byte i = count++;
+				for (; i > 1 && ACPI::getNodeDistance(local, order[i - 1]) > ACPI::getNodeDistance(local, node); i--)
+					order[i] = order[i - 1];
+				order[i] = node;
+			}
+			PageFrame::SetNodeOrder(order, count);
+		}
+
 		VERBOSE_LOG("Creating allocation heap...\n");
-		selectedHeap = Heap::build(entry.base_address, entry.length);
-		// Heap::selectHeap(Heap::build(entry.base_address + diff, entry.length - diff));
+		qword heapSize = initialHeapSize;
+		PageFrame::SetInterruptGuard(saveAndDisableInterrupts, restoreInterrupts);
+		void *heapSpace = PageFrame::AllocateRange(heapSize);
+		while (heapSpace == nullptr && heapSize > PageFrame::frameSize)
+		{
+			heapSize /= 2;
+			heapSpace = PageFrame::AllocateRange(heapSize);
+		}
+		if (heapSpace == nullptr)
+			System::blueScreen();
+		// the kernel heap records its callers for the heap profiler
+		selectedHeap = Heap::build(heapSpace, heapSize, true);
+		selectedHeap->setMemorySource(requestHeapMemory, releaseHeapMemory);
+		selectedHeap->setReclaimer(Shrinker::Shrink);
+		// big buffers take frames straight from the frame allocator, and give them back when they are freed
+		selectedHeap->setLargeObjectSource(PageFrame::AllocateRange, PageFrame::DeallocateRange);
+		Shrinker::Register(Shrinker::Shrinker{"Zeroed frames", PageFrame::getZeroedCount, PageFrame::DrainZeroPool, PageFrame::frameSize});
+		selectedHeap->setCPUSource(enterHeapCPU, leaveHeapCPU);
+		selectedHeap->setLock(lockHeap, leaveHeapCPU);
+		Shrinker::Register(Shrinker::Shrinker{"Heap magazines", countDepotBytes, drainDepot, 1});
+		Shrinker::Register(Shrinker::Shrinker{"Empty heap arena", countEmptyArenaBytes, releaseEmptyArena, 1});
 
 		VERBOSE_LOG("Allocating and mapping the interrupt stacks...\n");
-		byte *interruptStack = (byte *)Memory::Allocate(0x6000, 0x1000);
+		byte *interruptStack = (byte *)PageFrame::AllocateRange(0x6000);
 
 		// map interrupt stack
-		if (!pml4->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80081000, (ull)interruptStack + 0x1000, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit)))
+		if (!pml4->mapRegion(0xFFFFFFFF80081000, (ull)interruptStack + 0x1000, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::globalPageBit)))
 			mappingFailed = true;
-		if (!pml4->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80083000, (ull)interruptStack + 0x3000, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit)))
+		if (!pml4->mapRegion(0xFFFFFFFF80083000, (ull)interruptStack + 0x3000, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::globalPageBit)))
 			mappingFailed = true;
-		if (!pml4->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80085000, (ull)interruptStack + 0x5000, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit)))
+		if (!pml4->mapRegion(0xFFFFFFFF80085000, (ull)interruptStack + 0x5000, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::globalPageBit)))
 			mappingFailed = true;
 
 		if (mappingFailed)
 			System::blueScreen();
-	}
 
-	void GetPageSpace(void *&retValPageSpace, dword *&retValPageAllocationMap)
-	{
-		retValPageSpace = pageSpace;
-		retValPageAllocationMap = &pageAllocationMap;
+		// let global pages survive CR3 reloads
+		qword cr4;
+		asm volatile("mov %[cr4], cr4" : [cr4] "=r"(cr4));
+		cr4 |= cr4GlobalPagesBit;
+		asm volatile("mov cr4, %[cr4]" : : [cr4] "r"(cr4));
 	}
 }
\ No newline at end of file
@@ -10,25 +10,30 @@ namespace Memory
 	std::string getStringMemoryMap();
 	void Initialize(byte *kernelPhysicalAddress, byte *mapEntryDescriptor, byte *mapEntries);
 
-	void GetPageSpace(void *&pageSpace, dword *&pageAllocationMap);
+	// copies and fills from this size up bypass the caches, whose content they would only evict
+	static constexpr ull nonTemporalThreshold = 0x40000;
+	// what memcpy and memset use below that size; rep movsb until SelectCopyRoutines has looked at the cpu
+	extern void (*copyRoutine)(void *dest, const void *src, ull len);
+	extern void (*fillRoutine)(void *ptr, ull len, byte val);
+	void CopyNonTemporal(void *dest, const void *src, ull len);
+	void FillNonTemporal(void *ptr, ull len, byte val);
+	void SelectCopyRoutines();
+	// report the speed of memcpy, memset and memmove for a range of sizes
+	void BenchmarkCopy();
 }
 
 inline void memcpy(void *dest, const void *src, ull len)
 {
-	asm volatile(
-		"cld\n"
-		"rep movsb"
-		: "=S"(src), "=D"(dest), "=c"(len)
-		: "S"(src), "D"(dest), "c"(len)
-	);
+	if (len >= Memory::nonTemporalThreshold)
+		Memory::CopyNonTemporal(dest, src, len);
+	else
+		Memory::copyRoutine(dest, src, len);
 }
 extern "C" void memmove(void *dest, const void *src, ull len);
 inline void memset(void *ptr, ull len, byte val)
 {
-	asm volatile(
-		"cld\n"
-		"rep stosb"
-		: "=D"(ptr), "=c"(len)
-		: "D"(ptr), "c"(len), "a"(val)
-	);
+	if (len >= Memory::nonTemporalThreshold)
+		Memory::FillNonTemporal(ptr, len, val);
+	else
+		Memory::fillRoutine(ptr, len, val);
 }
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "mem.h"
+#include "pageframe.h"
+#include "../cpu/cpuid.h"
+#include "../utils/time.h"
+#include <iostream.h>
+
+using namespace std;
+
+// the routines only use general purpose registers: the vector registers of the tasks are not saved when the kernel
+// is entered, so the kernel must not touch them
+namespace Memory
+{
+	static constexpr dword cpuidERMSBit = 1 << 9, // ebx of leaf 7
+		cpuidFSRMBit = 1 << 4;					   // edx of leaf 7
+
+	// with fast strings, rep movsb moves whole cache lines at once
+	void copyStrings(void *dest, const void *src, ull len)
+	{
+		asm volatile(
+			"cld\n"
+			"rep movsb"
+			: "+D"(dest), "+S"(src), "+c"(len)
+			:
+			: "memory");
+	}
+	// without them, it moves one byte at a time, so the bulk goes in qwords
+	void copyQwords(void *dest, const void *src, ull len)
+	{
+		ull qwords = len / 8;
+		asm volatile(
+			"cld\n"
+			"rep movsq\n"
+			"mov rcx, %[rest]\n"
+			"rep movsb"
+			: "+D"(dest), "+S"(src), "+c"(qwords)
+			: [rest] "r"(len % 8)
+			: "memory");
+	}
+	void fillStrings(void *ptr, ull len, byte val)
+	{
+		asm volatile(
+			"cld\n"
+			"rep stosb"
+			: "+D"(ptr), "+c"(len)
+			: "a"(val)
+			: "memory");
+	}
+	void fillQwords(void *ptr, ull len, byte val)
+	{
+		ull qwords = len / 8;
+		asm volatile(
+			"cld\n"
+			"rep stosq\n"
+			"mov rcx, %[rest]\n"
+			"rep stosb"
+			: "+D"(ptr), "+c"(qwords)
+			: "a"(val * 0x0101010101010101), [rest] "r"(len % 8)
+			: "memory");
+	}
+
+	void (*copyRoutine)(void *dest, const void *src, ull len) = copyStrings;
+	void (*fillRoutine)(void *ptr, ull len, byte val) = fillStrings;
+	const char *copyMethod = "rep movsb";
+
+	void CopyNonTemporal(void *dest, const void *src, ull len)
+	{
+		// the stores are the ones that have to be aligned
+		ull head = -(qword)dest & 7;
+		copyRoutine(dest, src, head);
+		byte *d = (byte *)dest + head;
+		const byte *s = (const byte *)src + head;
+		ull blocks = (len - head) / 32;
+		if (blocks)
+			asm volatile(
+				"1:\n"
+				"mov rax, [%[s]]\n"
+				"mov rdx, [%[s] + 8]\n"
+				"movnti [%[d]], rax\n"
+				"movnti [%[d] + 8], rdx\n"
+				"mov rax, [%[s] + 16]\n"
+				"mov rdx, [%[s] + 24]\n"
+				"movnti [%[d] + 16], rax\n"
+				"movnti [%[d] + 24], rdx\n"
+				"add %[s], 32\n"
+				"add %[d], 32\n"
+				"dec %[n]\n"
+				"jnz 1b\n"
+				// the stores are weakly ordered, they have to be complete before anyone reads the copy
+				"sfence"
+				: [d] "+r"(d), [s] "+r"(s), [n] "+r"(blocks)
+				:
+				: "rax", "rdx", "memory");
+		copyRoutine(d, s, (len - head) % 32);
+	}
+	void FillNonTemporal(void *ptr, ull len, byte val)
+	{
+		ull head = -(qword)ptr & 7;
+		fillRoutine(ptr, head, val);
+		byte *d = (byte *)ptr + head;
+		ull blocks = (len - head) / 32;
+		if (blocks)
+			asm volatile(
+				"1:\n"
+				"movnti [%[d]], %[v]\n"
+				"movnti [%[d] + 8], %[v]\n"
+				"movnti [%[d] + 16], %[v]\n"
+				"movnti [%[d] + 24], %[v]\n"
+				"add %[d], 32\n"
+				"dec %[n]\n"
+				"jnz 1b\n"
+				"sfence"
+				: [d] "+r"(d), [n] "+r"(blocks)
+				: [v] "r"(val * 0x0101010101010101)
+				: "memory");
+		fillRoutine(d, (len - head) % 32, val);
+	}
+
+	void SelectCopyRoutines()
+	{
+		dword eax, ebx, ecx, edx;
+		cpuid(0, eax, ebx, ecx, edx);
+		if (eax >= 7)
+			cpuid(7, 0, eax, ebx, ecx, edx);
+		else
+			ebx = edx = 0;
+
+		if (edx & cpuidFSRMBit)
+			copyMethod = "rep movsb (FSRM)";
+		else if (ebx & cpuidERMSBit)
+			copyMethod = "rep movsb (ERMS)";
+		else
+		{
+			copyRoutine = copyQwords;
+			fillRoutine = fillQwords;
+			copyMethod = "rep movsq";
+		}
+	}
+
+	// bytes per millisecond, shown as GB/s
+	void displaySpeed(ull bytes, ull clocks, ull clocksPerMs)
+	{
+		ull megabytes = bytes * clocksPerMs / (clocks ? clocks : 1) / 1000;
+		cout << "\t| " << megabytes / 1000 << '.' << (megabytes % 1000 < 100 ? "0" : "") << megabytes % 1000 / 10;
+	}
+	void BenchmarkCopy()
+	{
+		static constexpr qword bufferSize = 0x400000, bytesPerSize = 0x4000000;
+		byte *source = (byte *)PageFrame::AllocateRange(bufferSize),
+			 *destination = (byte *)PageFrame::AllocateRange(bufferSize);
+		if (source == nullptr || destination == nullptr)
+		{
+			cout << "Not enough memory for the buffers.\n";
+			if (source)
+				PageFrame::DeallocateRange(source, bufferSize);
+			if (destination)
+				PageFrame::DeallocateRange(destination, bufferSize);
+			return;
+		}
+		memset(source, bufferSize, 0x5a);
+		memset(destination, bufferSize, 0);
+
+		// the time stamp counter is measured against the timer over 100ms
+		qword start = Time::driver_time();
+		while (Time::driver_time() == start)
+			;
+		start = Time::driver_time();
+		qword clocks = Time::clock();
+		while (Time::driver_time() - start < 100)
+			;
+		ull clocksPerMs = (Time::clock() - clocks) / 100;
+
+		cout << "Using " << copyMethod << ", non-temporal stores from " << nonTemporalThreshold / 1024 << "KB\n";
+		cout << "Size    | memcpy GB/s | memset GB/s | memmove GB/s\n";
+		for (qword size = 64; size <= bufferSize; size *= 4)
+		{
+			ull iterations = bytesPerSize / size;
+			cout << (size < 1024 ? size : size / 1024) << (size < 1024 ? "B" : "KB");
+
+			clocks = Time::clock();
+			for (ull i = 0; i < iterations; i++)
+				memcpy(destination, source, size);
+			displaySpeed(size * iterations, Time::clock() - clocks, clocksPerMs);
+
+			clocks = Time::clock();
+			for (ull i = 0; i < iterations; i++)
+				memset(destination, size, (byte)i);
+			displaySpeed(size * iterations, Time::clock() - clocks, clocksPerMs);
+
+			// overlapping, in the direction that has to copy backwards
+			clocks = Time::clock();
+			for (ull i = 0; i < iterations; i++)
+				memmove(destination + size / 4, destination, size / 2);
+			displaySpeed(size / 2 * iterations, Time::clock() - clocks, clocksPerMs);
+			cout << '\n';
+		}
+
+		PageFrame::DeallocateRange(source, bufferSize);
+		PageFrame::DeallocateRange(destination, bufferSize);
+	}
+}
+
+extern "C" void memmove(void *dest, const void *src, ull len)
+{
+	// copying forwards is only wrong if the destination starts inside the source
+	if ((qword)dest - (qword)src >= len)
+		return memcpy(dest, src, len);
+
+	// backwards, with the direction flag set; the odd bytes at the end first, then the qwords
+	byte *d = (byte *)dest + len - 1;
+	const byte *s = (const byte *)src + len - 1;
+	ull rest = len % 8;
+	asm volatile(
+		"std\n"
+		"rep movsb\n"
+		"sub rsi, 7\n"
+		"sub rdi, 7\n"
+		"mov rcx, %[qwords]\n"
+		"rep movsq\n"
+		"cld"
+		: "+D"(d), "+S"(s), "+c"(rest)
+		: [qwords] "r"(len / 8)
+		: "memory");
+}
@@ -0,0 +1,95 @@
+#include "objectcache.h"
+#include "shrinker.h"
+#include "../cpu/interrupt/idt.h"
+#include <iostream.h>
+#include <math.h>
+
+using namespace std;
+
+ObjectCache *ObjectCache::caches = nullptr;
+
+ull ObjectCache::countFreeBytes()
+{
+	ull bytes = 0;
+	for (ObjectCache *cache = caches; cache; cache = cache->nextCache)
+		bytes += cache->freeCount * cache->objectSize;
+	return bytes;
+}
+ull ObjectCache::shrinkAll(ull bytes)
+{
+	ull freed = 0;
+	for (ObjectCache *cache = caches; cache && freed < bytes; cache = cache->nextCache)
+		freed += cache->shrink(integerCeilDivide(bytes - freed, cache->objectSize)) * cache->objectSize;
+	return freed;
+}
+
+// interrupts are disabled
+void ObjectCache::registerCache()
+{
+	// the first cache used brings the shrinker of all of them
+	if (caches == nullptr)
+		Shrinker::Register(Shrinker::Shrinker{"Object caches", countFreeBytes, shrinkAll, 1});
+	nextCache = caches;
+	caches = this;
+	registered = true;
+}
+
+void *ObjectCache::allocate()
+{
+	bool interruptsEnabled = saveAndDisableInterrupts();
+	if (!registered)
+		registerCache();
+	FreeObject *object = freeList;
+	if (object)
+	{
+		freeList = object->next;
+		freeCount--;
+		hits++;
+	}
+	else
+		misses++;
+	restoreInterrupts(interruptsEnabled);
+	return object ? object : ::operator new(objectSize);
+}
+void ObjectCache::deallocate(void *object)
+{
+	if (object == nullptr)
+		return;
+	bool interruptsEnabled = saveAndDisableInterrupts();
+	bool kept = freeCount < limit;
+	if (kept)
+	{
+		FreeObject *free = (FreeObject *)object;
+		free->next = freeList;
+		freeList = free;
+		freeCount++;
+	}
+	restoreInterrupts(interruptsEnabled);
+	if (!kept)
+		::operator delete(object);
+}
+ull ObjectCache::shrink(ull count)
+{
+	bool interruptsEnabled = saveAndDisableInterrupts();
+	ull freed = 0;
+	for (; freed < count && freeList; freed++)
+	{
+		FreeObject *object = freeList;
+		freeList = object->next;
+		freeCount--;
+		::operator delete(object);
+	}
+	restoreInterrupts(interruptsEnabled);
+	return freed;
+}
+
+void ObjectCache::DisplaySummary()
+{
+	cout << "Cache\t| Size\t| Hits\t| Misses\t| Hit rate\t| Free\n";
+	for (ObjectCache *cache = caches; cache; cache = cache->nextCache)
+	{
+		ull total = cache->hits + cache->misses;
+		cout << cache->name << "\t| " << cache->objectSize << "\t| " << cache->hits << "\t| " << cache->misses << "\t| "
+			 << (total ? cache->hits * 100 / total : 0) << "%\t| " << cache->freeCount << " of " << cache->limit << '\n';
+	}
+}
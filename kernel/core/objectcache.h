@@ -0,0 +1,60 @@
+#pragma once
+#include <types.h>
+#include <mem.h>
+
+// objects of one type that are created and destroyed often keep their memory on a free list when they are
+// destroyed, so that the next one is created without going through the heap; caches are global objects
+// built at compile time, since the kernel does not run constructors of globals
+class ObjectCache
+{
+	class FreeObject
+	{
+	public:
+		FreeObject *next;
+	};
+
+	const char *name;
+	qword objectSize;
+	// free objects kept at most; the others go back to the heap
+	ull limit;
+	FreeObject *freeList = nullptr;
+	ull freeCount = 0, hits = 0, misses = 0;
+	// every cache that was used is in a list, for the shrinker and the summary
+	static ObjectCache *caches;
+	ObjectCache *nextCache = nullptr;
+	bool registered = false;
+
+	void registerCache();
+	// the shrinker of all the caches counts in bytes, since their objects have different sizes
+	static ull countFreeBytes();
+	static ull shrinkAll(ull bytes);
+
+public:
+	constexpr ObjectCache(const char *name, qword objectSize, ull limit)
+		: name(name), objectSize(objectSize > sizeof(FreeObject) ? objectSize : sizeof(FreeObject)), limit(limit) {}
+
+	// both can be called from interrupts and from threads
+	void *allocate();
+	void deallocate(void *object);
+	// give up to count free objects back to the heap; returns how many were freed
+	ull shrink(ull count);
+
+	static void DisplaySummary();
+};
+
+// a cache for objects of type T; the class uses it in its own operator new and delete
+template <class T>
+class TypedObjectCache : public ObjectCache
+{
+public:
+	constexpr TypedObjectCache(const char *name, ull limit) : ObjectCache(name, sizeof(T), limit) {}
+
+	inline void *allocate(size_t size) { return size == sizeof(T) ? ObjectCache::allocate() : ::operator new(size); }
+	inline void deallocate(void *object, size_t size)
+	{
+		if (size == sizeof(T))
+			ObjectCache::deallocate(object);
+		else
+			::operator delete(object);
+	}
+};
@@ -0,0 +1,411 @@
+#include "pageframe.h"
+#include <iostream.h>
+#include <math.h>
+
+using namespace std;
+
+namespace PageFrame
+{
+	// metadata kept for every frame of a zone
+	class FrameInfo
+	{
+	public:
+		// order of the block that starts at this frame
+		dword order : 5;
+		// set only for the first frame of a free block
+		dword isFree : 1;
+		// number of owners besides the first one
+		dword shareCount : 26;
+
+		static constexpr dword maxShareCount = (1 << 26) - 1;
+	};
+
+	// free blocks are linked through their first frame; RAM is identity mapped, so the frames can be written directly
+	class FreeBlock
+	{
+	public:
+		FreeBlock *prev, *next;
+	};
+
+	class Zone
+	{
+	public:
+		qword firstFrame, frameCount, freeFrames;
+		byte node;
+		FrameInfo *frames;
+		FreeBlock *freeLists[orderCount];
+
+		inline bool contains(qword frame) { return frame >= firstFrame && frame < firstFrame + frameCount; }
+		inline FrameInfo &info(qword frame) { return frames[frame - firstFrame]; }
+
+		void insertFree(qword frame, byte order)
+		{
+			FreeBlock *block = (FreeBlock *)(frame * frameSize);
+			block->prev = nullptr;
+			block->next = freeLists[order];
+			if (freeLists[order])
+				freeLists[order]->prev = block;
+			freeLists[order] = block;
+
+			FrameInfo &frameInfo = info(frame);
+			frameInfo.order = order;
+			frameInfo.isFree = true;
+			freeFrames += (qword)1 << order;
+		}
+		void removeFree(qword frame, byte order)
+		{
+			FreeBlock *block = (FreeBlock *)(frame * frameSize);
+			if (block->prev)
+				block->prev->next = block->next;
+			else
+				freeLists[order] = block->next;
+			if (block->next)
+				block->next->prev = block->prev;
+
+			info(frame).isFree = false;
+			freeFrames -= (qword)1 << order;
+		}
+
+		// free a block and merge it with its buddies for as long as they are free too
+		void freeBlock(qword frame, byte order)
+		{
+			while (order < maxOrder)
+			{
+				qword buddy = frame ^ ((qword)1 << order);
+				if (!contains(buddy) || !info(buddy).isFree || info(buddy).order != order)
+					break;
+				removeFree(buddy, order);
+				if (buddy < frame)
+					frame = buddy;
+				order++;
+			}
+			insertFree(frame, order);
+		}
+		// free an arbitrary run of frames by splitting it into the biggest aligned blocks
+		void freeRange(qword frame, qword count)
+		{
+			while (count)
+			{
+				byte order = 0;
+				while (order < maxOrder && (frame & (((qword)2 << order) - 1)) == 0 && ((qword)2 << order) <= count)
+					order++;
+				freeBlock(frame, order);
+				frame += (qword)1 << order;
+				count -= (qword)1 << order;
+			}
+		}
+
+		void *allocate(byte order)
+		{
+			byte available = order;
+			while (available < orderCount && !freeLists[available])
+				available++;
+			if (available == orderCount)
+				return nullptr;
+
+			qword frame = (qword)freeLists[available] / frameSize;
+			removeFree(frame, available);
+
+			// give back the upper halves until the block has the requested size
+			while (available > order)
+			{
+				available--;
+				insertFree(frame + ((qword)1 << available), available);
+			}
+			info(frame).order = order;
+			return (void *)(frame * frameSize);
+		}
+	};
+
+	Zone zones[maxZoneCount];
+	byte zoneCount = 0;
+
+	byte nodeOrder[maxNodeCount];
+	byte nodeOrderCount = 0;
+	// allocations served by the preferred node, and by another one
+	ull localAllocations = 0, remoteAllocations = 0;
+
+	void *zeroPool[zeroPoolSize];
+	ull zeroPoolCount = 0;
+
+	bool (*enterGuard)() = nullptr;
+	void (*leaveGuard)(bool state) = nullptr;
+	inline bool lock() { return enterGuard ? enterGuard() : false; }
+	inline void unlock(bool state)
+	{
+		if (leaveGuard)
+			leaveGuard(state);
+	}
+	void SetInterruptGuard(bool (*enter)(), void (*leave)(bool state))
+	{
+		enterGuard = enter;
+		leaveGuard = leave;
+	}
+
+	Zone *getZone(qword frame)
+	{
+		for (byte i = 0; i < zoneCount; i++)
+			if (zones[i].contains(frame))
+				return &zones[i];
+		return nullptr;
+	}
+
+	// number of the smallest order that covers the given number of frames
+	byte getOrder(qword frameCount)
+	{
+		byte order = 0;
+		while (((qword)1 << order) < frameCount)
+			order++;
+		return order;
+	}
+
+	bool AddZone(qword base, qword length, qword reservedLength, byte node)
+	{
+		if (zoneCount == maxZoneCount)
+			return false;
+
+		qword start = alignValueUpwards(base, frameSize),
+			  end = (base + length) & ~(frameSize - 1);
+		if (end <= start)
+			return false;
+
+		Zone &zone = zones[zoneCount];
+		zone.firstFrame = start / frameSize;
+		zone.frameCount = (end - start) / frameSize;
+		zone.freeFrames = 0;
+		zone.node = node;
+		for (FreeBlock *&list : zone.freeLists)
+			list = nullptr;
+
+		// the metadata array goes after the reserved part of the zone
+		qword reservedFrames = integerCeilDivide(reservedLength, frameSize);
+		zone.frames = (FrameInfo *)(start + reservedFrames * frameSize);
+		reservedFrames += integerCeilDivide(zone.frameCount * sizeof(FrameInfo), frameSize);
+		if (reservedFrames >= zone.frameCount)
+			return false;
+
+		// reserved frames are left as allocated blocks of a single frame, so they can be freed later
+		for (qword i = 0; i < zone.frameCount; i++)
+			zone.frames[i] = FrameInfo{0, false, 0};
+		zoneCount++;
+		zone.freeRange(zone.firstFrame + reservedFrames, zone.frameCount - reservedFrames);
+		return true;
+	}
+
+	void *allocate(byte order)
+	{
+		if (order > maxOrder)
+			return nullptr;
+		if (nodeOrderCount == 0)
+		{
+			for (byte i = 0; i < zoneCount; i++)
+			{
+				void *block = zones[i].allocate(order);
+				if (block)
+					return block;
+			}
+			return nullptr;
+		}
+
+		for (byte n = 0; n < nodeOrderCount; n++)
+			for (byte i = 0; i < zoneCount; i++)
+			{
+				if (zones[i].node != nodeOrder[n])
+					continue;
+				void *block = zones[i].allocate(order);
+				if (block)
+				{
+					n == 0 ? localAllocations++ : remoteAllocations++;
+					return block;
+				}
+			}
+		return nullptr;
+	}
+	void SetNodeOrder(const byte *nodes, byte count)
+	{
+		nodeOrderCount = count < maxNodeCount ? count : maxNodeCount;
+		for (byte i = 0; i < nodeOrderCount; i++)
+			nodeOrder[i] = nodes[i];
+	}
+	void *Allocate(byte order)
+	{
+		bool state = lock();
+		void *block = allocate(order);
+		unlock(state);
+		return block;
+	}
+	void deallocate(void *block, byte order)
+	{
+		qword frame = (qword)block / frameSize;
+		Zone *zone = getZone(frame);
+		if (!zone || (qword)block & (frameSize - 1))
+		{
+			cout << "Attempted to free an invalid frame " << block << '\n';
+			return;
+		}
+		FrameInfo &info = zone->info(frame);
+		if (info.isFree)
+		{
+			cout << "Attempted to free the frame " << block << " twice\n";
+			return;
+		}
+		if (info.shareCount)
+		{
+			info.shareCount--;
+			return;
+		}
+		zone->freeBlock(frame, order);
+	}
+	void Deallocate(void *block, byte order)
+	{
+		bool state = lock();
+		deallocate(block, order);
+		unlock(state);
+	}
+
+	void *AllocateZeroed()
+	{
+		bool state = lock();
+		void *pooled = zeroPoolCount > 0 ? zeroPool[--zeroPoolCount] : nullptr;
+		unlock(state);
+		if (pooled)
+			return pooled;
+
+		qword *frame = (qword *)Allocate();
+		if (frame != nullptr)
+			for (ull i = 0; i < frameSize / sizeof(qword); i++)
+				frame[i] = 0;
+		return frame;
+	}
+	bool isZeroPoolFull() { return zeroPoolCount == zeroPoolSize; }
+	void AddZeroed(void *frame)
+	{
+		bool state = lock();
+		if (zeroPoolCount < zeroPoolSize)
+			zeroPool[zeroPoolCount++] = frame;
+		else
+			deallocate(frame, 0);
+		unlock(state);
+	}
+	ull DrainZeroPool(ull count)
+	{
+		bool state = lock();
+		ull freed = 0;
+		for (; freed < count && zeroPoolCount > 0; freed++)
+			deallocate(zeroPool[--zeroPoolCount], 0);
+		unlock(state);
+		return freed;
+	}
+	ull getZeroedCount() { return zeroPoolCount; }
+	void ZeroFrame(void *frame)
+	{
+		qword *ptr = (qword *)frame, *end = ptr + frameSize / sizeof(qword);
+		asm volatile(
+			"1:\n"
+			"movnti [%0], %1\n"
+			"movnti [%0 + 8], %1\n"
+			"movnti [%0 + 16], %1\n"
+			"movnti [%0 + 24], %1\n"
+			"add %0, 32\n"
+			"cmp %0, %2\n"
+			"jb 1b\n"
+			// the stores are weakly ordered, so they have to be complete before the frame is handed out
+			"sfence"
+			: "+r"(ptr)
+			: "r"((qword)0), "r"(end)
+			: "memory");
+	}
+
+	bool Share(void *block)
+	{
+		Zone *zone = getZone((qword)block / frameSize);
+		if (zone == nullptr)
+			return false;
+		FrameInfo &info = zone->info((qword)block / frameSize);
+		bool state = lock();
+		bool shared = info.shareCount < FrameInfo::maxShareCount;
+		if (shared)
+			info.shareCount++;
+		unlock(state);
+		return shared;
+	}
+	bool isShared(void *block)
+	{
+		Zone *zone = getZone((qword)block / frameSize);
+		return zone && zone->info((qword)block / frameSize).shareCount;
+	}
+
+	void *AllocateRange(qword len)
+	{
+		qword frameCount = integerCeilDivide(len, frameSize);
+		byte order = getOrder(frameCount);
+		bool state = lock();
+		void *block = allocate(order);
+		if (block)
+		{
+			qword frame = (qword)block / frameSize;
+			getZone(frame)->freeRange(frame + frameCount, ((qword)1 << order) - frameCount);
+		}
+		unlock(state);
+		return block;
+	}
+	void DeallocateRange(void *block, qword len)
+	{
+		qword frame = (qword)block / frameSize;
+		Zone *zone = getZone(frame);
+		if (!zone || (qword)block & (frameSize - 1))
+		{
+			cout << "Attempted to free an invalid frame " << block << '\n';
+			return;
+		}
+		bool state = lock();
+		zone->freeRange(frame, integerCeilDivide(len, frameSize));
+		unlock(state);
+	}
+
+	bool isManaged(void *address) { return getZone((qword)address / frameSize) != nullptr; }
+
+	qword getTotalMemory()
+	{
+		qword frames = 0;
+		for (byte i = 0; i < zoneCount; i++)
+			frames += zones[i].frameCount;
+		return frames * frameSize;
+	}
+	qword getFreeMemory()
+	{
+		qword frames = 0;
+		for (byte i = 0; i < zoneCount; i++)
+			frames += zones[i].freeFrames;
+		return frames * frameSize;
+	}
+
+	void DisplaySummary()
+	{
+		for (byte i = 0; i < zoneCount; i++)
+		{
+			Zone &zone = zones[i];
+			cout << "Zone " << i << " (node " << zone.node << "): " << (void *)(zone.firstFrame * frameSize) << " - " << (void *)((zone.firstFrame + zone.frameCount) * frameSize - 1)
+				 << ", " << zone.freeFrames << " of " << zone.frameCount << " frames free\n";
+			cout << "Free blocks per order:";
+			for (byte order = 0; order < orderCount; order++)
+			{
+				ull count = 0;
+				for (FreeBlock *block = zone.freeLists[order]; block; block = block->next)
+					count++;
+				cout << ' ' << count;
+			}
+			cout << '\n';
+		}
+		cout << "Free memory: " << getFreeMemory() / 1024 << "KB of " << getTotalMemory() / 1024 << "KB\n";
+		cout << "Zeroed frames: " << zeroPoolCount << " of " << zeroPoolSize << '\n';
+		if (nodeOrderCount)
+		{
+			ull total = localAllocations + remoteAllocations;
+			cout << "Node-local allocations: " << localAllocations << " of " << total;
+			if (total)
+				cout << " (" << localAllocations * 100 / total << "%)";
+			cout << '\n';
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <types.h>
+
+// system-wide physical page frame allocator
+// every usable region of RAM is a zone managed by a binary buddy system: a free block of 2^order frames is
+// always aligned to its size, and it can be merged back with its buddy (the other half of the parent block)
+namespace PageFrame
+{
+	static constexpr qword frameSize = 0x1000;
+	// blocks of up to 2^18 frames (1GB)
+	static constexpr byte maxOrder = 18, orderCount = maxOrder + 1;
+	static constexpr byte maxZoneCount = 32;
+	// zones never span two NUMA nodes
+	static constexpr byte maxNodeCount = 8;
+	// frames kept zeroed ahead of time (1MB)
+	static constexpr ull zeroPoolSize = 256;
+
+	// add a region of usable RAM to the allocator; the first reservedLength bytes are left allocated.
+	// the frame metadata of the zone is stored inside the zone itself, right after the reserved part
+	bool AddZone(qword base, qword length, qword reservedLength = 0, byte node = 0);
+	// interrupt handlers take frames too: every function that changes the state of the allocator runs between
+	// enter and leave, which the kernel sets to disable interrupts; enter returns the state that leave restores
+	void SetInterruptGuard(bool (*enter)(), void (*leave)(bool state));
+	// nodes that Allocate takes frames from, in order of preference: the node of the cpu first, then the nearest ones;
+	// until it is set, zones are used in the order they were added
+	void SetNodeOrder(const byte *nodes, byte count);
+
+	// allocate a block of 2^order frames, aligned to its size; returns nullptr if there is no free block big enough
+	void *Allocate(byte order = 0);
+	// free a block allocated with Allocate; a shared frame is only freed once every owner deallocated it
+	void Deallocate(void *frame, byte order = 0);
+
+	// allocate a single frame filled with zeros, from the pool of zeroed frames if it is not empty
+	void *AllocateZeroed();
+	// the idle thread zeroes frames taken with Allocate and gives them to the pool
+	bool isZeroPoolFull();
+	void AddZeroed(void *frame);
+	// give up to count frames of the pool back; returns how many were freed
+	ull DrainZeroPool(ull count);
+	ull getZeroedCount();
+	// fill a frame with non-temporal stores, which leave the cache to the code that runs after the idle thread
+	void ZeroFrame(void *frame);
+
+	// add an owner to an allocated frame, for pages mapped in more than one address space;
+	// returns false if the frame has as many owners as it can count, the caller has to make a copy then
+	bool Share(void *frame);
+	bool isShared(void *frame);
+
+	// allocate enough continuous frames to cover len bytes; unused frames of the block are given back
+	void *AllocateRange(qword len);
+	// free a range allocated with AllocateRange
+	void DeallocateRange(void *frames, qword len);
+
+	// returns true if the address belongs to a zone
+	bool isManaged(void *address);
+
+	qword getTotalMemory();
+	qword getFreeMemory();
+	void DisplaySummary();
+}
@@ -1,14 +1,48 @@
 #include "paging.h"
+#include "pageframe.h"
 #include <iostream.h>
 
 using namespace std;
 
+PageMapLevel4 *kernelPaging = nullptr;
+bool PageDirectoryPointerTable::bigPagesEnabled = true;
+
+void InvalidationList::flush()
+{
+	if (overflow)
+		return flushAll();
+	for (byte i = 0; i < count; i++)
+		asm volatile("invlpg [%[page]]" : : [page] "r"(pages[i]) : "memory");
+	count = 0;
+}
+void InvalidationList::flushAll()
+{
+	// toggling CR4.PGE drops the global entries too
+	qword cr4;
+	asm volatile("mov %[cr4], cr4" : [cr4] "=r"(cr4));
+	if (cr4 & (1 << 7))
+	{
+		asm volatile("mov cr4, %[cr4]" : : [cr4] "r"(cr4 & ~(qword)(1 << 7)) : "memory");
+		asm volatile("mov cr4, %[cr4]" : : [cr4] "r"(cr4) : "memory");
+	}
+	else
+	{
+		qword cr3;
+		asm volatile("mov %[cr3], cr3" : [cr3] "=r"(cr3));
+		asm volatile("mov cr3, %[cr3]" : : [cr3] "r"(cr3) : "memory");
+	}
+}
+
 // in pt: 4kb pages (0x1000)
 // in pd: 2mb pages (0x200000)
 // in pdpt: 1gb pages (0x40000000)
 
+// without a page space, paging structures are taken from the page frame allocator
 void *AllocatePage(void *pageSpace, dword &pageAllocationMap)
 {
+	if (pageSpace == nullptr)
+		return PageFrame::AllocateZeroed();
+
 	if (pageAllocationMap == (dword)(-1))
 		return nullptr; // no more space to allocate
 
@@ -28,6 +62,12 @@ void *AllocatePage(void *pageSpace, dword &pageAllocationMap)
 }
 void DeallocatePage(void *pageSpace, dword &pageAllocationMap, void *table)
 {
+	if (pageSpace == nullptr)
+	{
+		PageFrame::Deallocate(table);
+		return;
+	}
+
 	// get index
 	qword bitIndex = ((qword)table - (qword)pageSpace) / 0x1000;
 
@@ -35,22 +75,27 @@ void DeallocatePage(void *pageSpace, dword &pageAllocationMap, void *table)
 	pageAllocationMap &= (dword)(-1) ^ (1 << bitIndex);
 }
 
+// record a changed range, if the caller wants it invalidated
+inline void invalidate(InvalidationList *invalidations, qword virtualAddress, qword len)
+{
+	if (invalidations)
+		invalidations->add(virtualAddress, len);
+}
+
 void getEntryBounds(qword virtualAddress, qword len, word &startEntry, word &endEntry, int bitShift)
 {
 	const qword virtualAddress_max = virtualAddress + len - 1;
 	const int bitShift_parentEntries = bitShift + 9;
 
 	startEntry = (virtualAddress >> bitShift) & 0x1ff;
-	if (
-		(virtualAddress >> (bitShift + 9)) !=
-		((virtualAddress + len - 1) >> (bitShift + 9)))
+	if ((virtualAddress >> bitShift_parentEntries) != (virtualAddress_max >> bitShift_parentEntries))
 	{
 		// endEntry in different region, snap to max entry
 		endEntry = PageEntry::entriesPerTable - 1;
 	}
 	else
 	{
-		endEntry = ((virtualAddress + len - 1) >> bitShift) & 0x1ff;
+		endEntry = (virtualAddress_max >> bitShift) & 0x1ff;
 	}
 }
 
@@ -96,7 +141,7 @@ bool PageTable::canBeCollapsed(void *pageSpace, dword &pageAllocationMap, qword
 
 	return true;
 }
-bool PageTable::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes)
+bool PageTable::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes, InvalidationList *invalidations)
 {
 	word startEntry, endEntry;
 	getEntryBounds(virtualAddress, len, startEntry, endEntry, 12);
@@ -104,6 +149,8 @@ bool PageTable::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtu
 	for (word i = startEntry; i <= endEntry; i++)
 	{
 		PageTableEntry &entry = entries[i];
+		if (entry.isPresent())
+			invalidate(invalidations, (virtualAddress & ~(bytesPerEntry - 1)) + (i - startEntry) * bytesPerEntry, bytesPerEntry);
 		// page table entries always point to physical pages, no need to deallocate child tables
 		entry.set(physicalAddress, attributes);
 
@@ -113,9 +160,23 @@ bool PageTable::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtu
 
 	return true;
 }
+bool PageTable::unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len, InvalidationList *invalidations)
+{
+	word startEntry, endEntry;
+	getEntryBounds(virtualAddress, len, startEntry, endEntry, 12);
+
+	for (word i = startEntry; i <= endEntry; i++)
+	{
+		if (entries[i].isPresent())
+			invalidate(invalidations, (virtualAddress & ~(bytesPerEntry - 1)) + (i - startEntry) * bytesPerEntry, bytesPerEntry);
+		entries[i].clear();
+	}
+
+	return true;
+}
 void PageTable::clearAll(void *pageSpace, dword &pageAllocationMap)
 {
-	for (int i = 0; i < PageEntry::entriesPerTable; i++)
+	for (qword i = 0; i < PageEntry::entriesPerTable; i++)
 		entries[i].clear();
 }
 bool PageTable::getPhysicalAddress(qword virtualAddress, qword &physicalAddress, bool isUserAccess)
@@ -211,7 +272,7 @@ bool PageDirectory::canBeCollapsed(void *pageSpace, dword &pageAllocationMap, qw
 
 	return true;
 }
-bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes)
+bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes, InvalidationList *invalidations)
 {
 	word startEntry, endEntry;
 	getEntryBounds(virtualAddress, len, startEntry, endEntry, 21);
@@ -244,7 +305,7 @@ bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 						// expand and map the region
 						if (entry.expand(pageSpace, pageAllocationMap) == false)
 							return false;
-						if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+						if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 							return false;
 					}
 				}
@@ -255,13 +316,14 @@ bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 					if (table->canBeCollapsed(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
 					{
 						qword physicalAddress_base = physicalAddress - (virtualAddress - virtualAddress_entryBase);
+						invalidate(invalidations, virtualAddress_entryBase, bytesPerEntry);
 						table->clearAll(pageSpace, pageAllocationMap);
 						DeallocatePage(pageSpace, pageAllocationMap, table);
 						entry.set(physicalAddress_base, attributes);
 					}
 					else
 					{
-						if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+						if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 							return false;
 					}
 				}
@@ -273,7 +335,7 @@ bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 				if (table == nullptr)
 					return false;
 				entry.set(table);
-				if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+				if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 					return false;
 			}
 
@@ -299,6 +361,7 @@ bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 			{
 				if (aligned)
 				{
+					invalidate(invalidations, virtualAddress_entryBase, bytesPerEntry);
 					// entry is present
 					if (!entry.isPageBig())
 					{
@@ -313,12 +376,13 @@ bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 				{
 					if (entry.isPageBig())
 					{
+						invalidate(invalidations, virtualAddress_entryBase, bytesPerEntry);
 						PageTable *table = (PageTable *)AllocatePage(pageSpace, pageAllocationMap);
 						if (table == nullptr)
 							return false;
 						entry.set(table);
 					}
-					if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+					if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 						return false;
 				}
 			}
@@ -335,7 +399,7 @@ bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 					if (table == nullptr)
 						return false;
 					entry.set(table);
-					if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+					if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 						return false;
 				}
 			}
@@ -349,9 +413,54 @@ bool PageDirectory::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 
 	return true;
 }
+bool PageDirectory::unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len, InvalidationList *invalidations)
+{
+	word startEntry, endEntry;
+	getEntryBounds(virtualAddress, len, startEntry, endEntry, 21);
+
+	for (word i = startEntry; i <= endEntry; i++)
+	{
+		PageDirectoryEntry &entry = entries[i];
+
+		const qword virtualAddress_entryBase = virtualAddress & ~(bytesPerEntry - 1);
+		qword partialLen = bytesPerEntry - (virtualAddress - virtualAddress_entryBase);
+		if (partialLen > len)
+			partialLen = len;
+
+		if (entry.isPresent())
+		{
+			if (partialLen < bytesPerEntry)
+			{
+				// partial entry: a big page has to be expanded first, to keep the rest of it mapped
+				if (entry.isPageBig() && !entry.expand(pageSpace, pageAllocationMap))
+					return false;
+				if (!entry.getTable()->unmapRegion(pageSpace, pageAllocationMap, virtualAddress, partialLen, invalidations))
+					return false;
+			}
+			else
+			{
+				invalidate(invalidations, virtualAddress_entryBase, bytesPerEntry);
+				// entire entry: drop the child table, if any
+				if (!entry.isPageBig())
+				{
+					PageTable *table = entry.getTable();
+					table->clearAll(pageSpace, pageAllocationMap);
+					DeallocatePage(pageSpace, pageAllocationMap, table);
+				}
+				entry.clear();
+			}
+		}
+
+		// increment stuff
+		virtualAddress += partialLen;
+		len -= partialLen;
+	}
+
+	return true;
+}
 void PageDirectory::clearAll(void *pageSpace, dword &pageAllocationMap)
 {
-	for (int i = 0; i < PageEntry::entriesPerTable; i++)
+	for (qword i = 0; i < PageEntry::entriesPerTable; i++)
 	{
 		PageDirectoryEntry &entry = entries[i];
 		// recursively deallocate child tables
@@ -390,7 +499,7 @@ bool PageDirectoryPointerTableEntry::expand(void *pageSpace, dword &pageAllocati
 	this->set(table);
 	return true;
 }
-bool PageDirectoryPointerTable::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes)
+bool PageDirectoryPointerTable::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes, InvalidationList *invalidations)
 {
 	word startEntry, endEntry;
 	getEntryBounds(virtualAddress, len, startEntry, endEntry, 30);
@@ -417,23 +526,24 @@ bool PageDirectoryPointerTable::mapRegion(void *pageSpace, dword &pageAllocation
 					{
 						if (entry.expand(pageSpace, pageAllocationMap) == false)
 							return false;
-						if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+						if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 							return false;
 					}
 				}
 				else
 				{
 					PageDirectory *table = entry.getTable();
-					if (table->canBeCollapsed(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+					if (bigPagesEnabled && table->canBeCollapsed(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
 					{
 						qword physicalAddress_base = physicalAddress - (virtualAddress - virtualAddress_entryBase);
+						invalidate(invalidations, virtualAddress_entryBase, bytesPerEntry);
 						table->clearAll(pageSpace, pageAllocationMap);
 						DeallocatePage(pageSpace, pageAllocationMap, table);
 						entry.set(physicalAddress_base, attributes);
 					}
 					else
 					{
-						if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+						if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 							return false;
 					}
 				}
@@ -445,7 +555,7 @@ bool PageDirectoryPointerTable::mapRegion(void *pageSpace, dword &pageAllocation
 				if (table == nullptr)
 					return false;
 				entry.set(table);
-				if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+				if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 					return false;
 			}
 
@@ -461,12 +571,14 @@ bool PageDirectoryPointerTable::mapRegion(void *pageSpace, dword &pageAllocation
 		else
 		{
 			// middle, impartial entry
-			bool aligned = (physicalAddress & (bytesPerEntry - 1)) == 0;
+			// without 1GB pages, an aligned range is mapped like an unaligned one, with a directory of 2MB pages
+			bool aligned = bigPagesEnabled && (physicalAddress & (bytesPerEntry - 1)) == 0;
 
 			if (entry.isPresent())
 			{
 				if (aligned)
 				{
+					invalidate(invalidations, virtualAddress_entryBase, bytesPerEntry);
 					if (!entry.isPageBig())
 					{
 						PageDirectory *table = entry.getTable();
@@ -479,12 +591,13 @@ bool PageDirectoryPointerTable::mapRegion(void *pageSpace, dword &pageAllocation
 				{
 					if (entry.isPageBig())
 					{
+						invalidate(invalidations, virtualAddress_entryBase, bytesPerEntry);
 						PageDirectory *table = (PageDirectory *)AllocatePage(pageSpace, pageAllocationMap);
 						if (table == nullptr)
 							return false;
 						entry.set(table);
 					}
-					if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+					if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 						return false;
 				}
 			}
@@ -500,7 +613,7 @@ bool PageDirectoryPointerTable::mapRegion(void *pageSpace, dword &pageAllocation
 					if (table == nullptr)
 						return false;
 					entry.set(table);
-					if (!table->mapRegion(pageSpace,pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+					if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations))
 						return false;
 				}
 			}
@@ -514,9 +627,54 @@ bool PageDirectoryPointerTable::mapRegion(void *pageSpace, dword &pageAllocation
 
 	return true;
 }
+bool PageDirectoryPointerTable::unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len, InvalidationList *invalidations)
+{
+	word startEntry, endEntry;
+	getEntryBounds(virtualAddress, len, startEntry, endEntry, 30);
+
+	for (word i = startEntry; i <= endEntry; i++)
+	{
+		PageDirectoryPointerTableEntry &entry = entries[i];
+
+		const qword virtualAddress_entryBase = virtualAddress & ~(bytesPerEntry - 1);
+		qword partialLen = bytesPerEntry - (virtualAddress - virtualAddress_entryBase);
+		if (partialLen > len)
+			partialLen = len;
+
+		if (entry.isPresent())
+		{
+			if (partialLen < bytesPerEntry)
+			{
+				// partial entry: a big page has to be expanded first, to keep the rest of it mapped
+				if (entry.isPageBig() && !entry.expand(pageSpace, pageAllocationMap))
+					return false;
+				if (!entry.getTable()->unmapRegion(pageSpace, pageAllocationMap, virtualAddress, partialLen, invalidations))
+					return false;
+			}
+			else
+			{
+				invalidate(invalidations, virtualAddress_entryBase, bytesPerEntry);
+				// entire entry: drop the child table, if any
+				if (!entry.isPageBig())
+				{
+					PageDirectory *table = entry.getTable();
+					table->clearAll(pageSpace, pageAllocationMap);
+					DeallocatePage(pageSpace, pageAllocationMap, table);
+				}
+				entry.clear();
+			}
+		}
+
+		// increment stuff
+		virtualAddress += partialLen;
+		len -= partialLen;
+	}
+
+	return true;
+}
 void PageDirectoryPointerTable::clearAll(void *pageSpace, dword &pageAllocationMap)
 {
-	for (int i = 0; i < PageEntry::entriesPerTable; i++)
+	for (qword i = 0; i < PageEntry::entriesPerTable; i++)
 	{
 		PageDirectoryPointerTableEntry &entry = entries[i];
 		// recursively deallocate child tables
@@ -543,6 +701,14 @@ bool PageDirectoryPointerTable::getPhysicalAddress(qword virtualAddress, qword &
 }
 
 bool PageMapLevel4::mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes)
+{
+	InvalidationList invalidations;
+	bool success = mapEntries(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, invalidations);
+	if (isLoaded())
+		invalidations.flush();
+	return success;
+}
+bool PageMapLevel4::mapEntries(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes, InvalidationList &invalidations)
 {
 	word startEntry, endEntry;
 	getEntryBounds(virtualAddress, len, startEntry, endEntry, 39);
@@ -561,7 +727,7 @@ bool PageMapLevel4::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 			// partial entry: first, last, or both
 			if (entry.isPresent())
 			{
-				if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+				if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, &invalidations))
 					return false;
 			}
 			else
@@ -570,7 +736,7 @@ bool PageMapLevel4::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 				if (table == nullptr)
 					return false;
 				entry.set(table);
-				if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+				if (!table->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, &invalidations))
 					return false;
 			}
 
@@ -592,7 +758,7 @@ bool PageMapLevel4::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 				table->clearAll(pageSpace, pageAllocationMap);
 				entry.set(table);
 			}
-			if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes))
+			if (!entry.getTable()->mapRegion(pageSpace, pageAllocationMap, virtualAddress, physicalAddress, len, attributes, &invalidations))
 				return false;
 
 			physicalAddress += bytesPerEntry;
@@ -603,9 +769,57 @@ bool PageMapLevel4::mapRegion(void *pageSpace, dword &pageAllocationMap, qword v
 
 	return true;
 }
+bool PageMapLevel4::unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len)
+{
+	InvalidationList invalidations;
+	bool success = unmapEntries(pageSpace, pageAllocationMap, virtualAddress, len, invalidations);
+	if (isLoaded())
+		invalidations.flush();
+	return success;
+}
+bool PageMapLevel4::unmapEntries(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len, InvalidationList &invalidations)
+{
+	word startEntry, endEntry;
+	getEntryBounds(virtualAddress, len, startEntry, endEntry, 39);
+
+	for (word i = startEntry; i <= endEntry; i++)
+	{
+		PageMapLevel4Entry &entry = entries[i];
+
+		const qword virtualAddress_entryBase = virtualAddress & ~(bytesPerEntry - 1);
+		qword partialLen = bytesPerEntry - (virtualAddress - virtualAddress_entryBase);
+		if (partialLen > len)
+			partialLen = len;
+
+		if (entry.isPresent())
+		{
+			if (partialLen < bytesPerEntry)
+			{
+				// partial entry: pass the operation to the child table
+				if (!entry.getTable()->unmapRegion(pageSpace, pageAllocationMap, virtualAddress, partialLen, &invalidations))
+					return false;
+			}
+			else
+			{
+				invalidations.add(virtualAddress_entryBase, bytesPerEntry);
+				// entire entry: drop the child table
+				PageDirectoryPointerTable *table = entry.getTable();
+				table->clearAll(pageSpace, pageAllocationMap);
+				DeallocatePage(pageSpace, pageAllocationMap, table);
+				entry.clear();
+			}
+		}
+
+		// increment stuff
+		virtualAddress += partialLen;
+		len -= partialLen;
+	}
+
+	return true;
+}
 void PageMapLevel4::clearAll(void *pageSpace, dword &pageAllocationMap)
 {
-	for (int i = 0; i < PageEntry::entriesPerTable; i++)
+	for (qword i = 0; i < PageEntry::entriesPerTable; i++)
 	{
 		PageMapLevel4Entry &entry = entries[i];
 		// recursively deallocate child tables
@@ -628,6 +842,56 @@ bool PageMapLevel4::getPhysicalAddress(qword virtualAddress, qword &physicalAddr
 	return entry.getTable()->getPhysicalAddress(virtualAddress, physicalAddress, isUserAccess);
 }
 
+PageTableEntry *PageMapLevel4::getPageTableEntry(qword virtualAddress, bool split)
+{
+	dword unused = 0;
+	PageMapLevel4Entry &pml4Entry = entries[(virtualAddress >> 39) & 0x1ff];
+	if (!pml4Entry.isPresent())
+		return nullptr;
+	PageDirectoryPointerTableEntry &pdptEntry = pml4Entry.getTable()->entries[(virtualAddress >> 30) & 0x1ff];
+	if (!pdptEntry.isPresent() || (pdptEntry.isPageBig() && (!split || !pdptEntry.expand(nullptr, unused))))
+		return nullptr;
+	PageDirectoryEntry &pdEntry = pdptEntry.getTable()->entries[(virtualAddress >> 21) & 0x1ff];
+	if (!pdEntry.isPresent() || (pdEntry.isPageBig() && (!split || !pdEntry.expand(nullptr, unused))))
+		return nullptr;
+	PageTableEntry &entry = pdEntry.getTable()->entries[(virtualAddress >> 12) & 0x1ff];
+	return entry.isPresent() ? &entry : nullptr;
+}
+PageTableEntry *PageMapLevel4::getSwappedEntry(qword virtualAddress)
+{
+	PageTable *table = getPageTable(virtualAddress);
+	if (table == nullptr)
+		return nullptr;
+	PageTableEntry &entry = table->entries[(virtualAddress >> 12) & 0x1ff];
+	return entry.isSwapped() ? &entry : nullptr;
+}
+PageTable *PageMapLevel4::getPageTable(qword virtualAddress)
+{
+	PageMapLevel4Entry &pml4Entry = entries[(virtualAddress >> 39) & 0x1ff];
+	if (!pml4Entry.isPresent())
+		return nullptr;
+	PageDirectoryPointerTableEntry &pdptEntry = pml4Entry.getTable()->entries[(virtualAddress >> 30) & 0x1ff];
+	if (!pdptEntry.isPresent() || pdptEntry.isPageBig())
+		return nullptr;
+	PageDirectoryEntry &pdEntry = pdptEntry.getTable()->entries[(virtualAddress >> 21) & 0x1ff];
+	if (!pdEntry.isPresent() || pdEntry.isPageBig())
+		return nullptr;
+	return pdEntry.getTable();
+}
+
+bool PageMapLevel4::isLoaded() { return this == kernelPaging; }
+
+void PageMapLevel4::shareKernelHalf(PageMapLevel4 &kernel)
+{
+	for (qword i = kernelEntriesStart; i < PageEntry::entriesPerTable; i++)
+		entries[i] = kernel.entries[i];
+}
+void PageMapLevel4::unshareKernelHalf()
+{
+	for (qword i = kernelEntriesStart; i < PageEntry::entriesPerTable; i++)
+		entries[i].clear();
+}
+
 PageMapLevel4 *PageMapLevel4::create(void *pageSpace, dword &pageAllocationMap)
 {
 	return (PageMapLevel4 *)AllocatePage(pageSpace, pageAllocationMap);
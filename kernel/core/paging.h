@@ -26,35 +26,47 @@ public:
 		accessedBit = 1 << 5,
 		dirtyBit = 1 << 6,
 
-		pageSizeBit = 1 << 7;
+		pageSizeBit = 1 << 7,
+		// the translation is kept in the TLB when CR3 changes; only for mappings that are the same in every address space
+		globalPageBit = 1 << 8,
+
+		// bits ignored by the cpu, free for the kernel to use
+		copyOnWriteBit = 1 << 9,
+		// set in an entry that is not present, whose page is in the swap file
+		swappedBit = 1 << 10;
 
 	class EntryAttributes
 	{
-		static constexpr byte attributeMask = PageEntry::writeAccessBit | PageEntry::userPageBit | PageEntry::pageWriteThroughBit | PageEntry::pageCacheDisable;
+		static constexpr word attributeMask = PageEntry::writeAccessBit | PageEntry::userPageBit | PageEntry::pageWriteThroughBit | PageEntry::pageCacheDisable | PageEntry::globalPageBit;
 
-		byte reserved1 : 1;
+		word reserved1 : 1;
 	public:
-		byte writeAccess : 1;
-		byte userPage : 1;
-		byte pageWriteThrough : 1;
-		byte pageCacheDisable : 1;
+		word writeAccess : 1;
+		word userPage : 1;
+		word pageWriteThrough : 1;
+		word pageCacheDisable : 1;
 
 	private:
-		byte reserved2: 3;
+		word reserved2 : 3;
+	public:
+		word globalPage : 1;
 
-		inline void set(byte bitmask)
+	private:
+		word reserved3 : 7;
+
+		inline void set(word bitmask)
 		{
-			*(byte*)this = bitmask & attributeMask;
+			*(word*)this = bitmask & attributeMask;
 		}
 
 	public:
-		inline EntryAttributes(byte bitmask = 0)
+		inline EntryAttributes(word bitmask = 0)
 		{
 			set(bitmask);
 		}
-		inline byte get()
+		inline word get()
 		{
-			return (*(byte*)this) & attributeMask;
+			return (*(word*)this) & attributeMask;
 		}
 		inline bool operator==(EntryAttributes other)
 		{
@@ -72,7 +84,7 @@ protected:
 
 	inline void setAddress(qword maskedAddress)
 	{
-		value = value & (~addressMask_4kb) | maskedAddress;
+		value = (value & ~addressMask_4kb) | maskedAddress;
 	}
 
 public:
@@ -101,8 +113,22 @@ public:
 	inline void set(qword physicalAddress, EntryAttributes attributes) { PageEntry::set(physicalAddress & addressMask_4kb, attributes); }
 
 	inline void clearDirty() { value &= ~dirtyBit; }
+	// a copy on write page is mapped read-only, and gets copied on the first write to it
+	inline void setCopyOnWrite(bool copyOnWrite)
+	{
+		if (copyOnWrite)
+			value = (value & ~writeAccessBit) | copyOnWriteBit;
+		else
+			value = (value & ~copyOnWriteBit) | writeAccessBit;
+	}
+
+	// the entry of a swapped out page holds its slot in the swap file instead of an address
+	inline void setSwapped(qword slot) { value = slot << 12 | swappedBit; }
 
 	inline bool isDirty() { return value & dirtyBit; }
+	inline bool isCopyOnWrite() { return value & copyOnWriteBit; }
+	inline bool isSwapped() { return !isPresent() && (value & swappedBit); }
+	inline qword getSwapSlot() { return getAddress() >> 12; }
 };
 class PageDirectoryEntry : public PageEntry
 {
@@ -151,6 +177,37 @@ public:
 	inline void set(PageDirectoryPointerTable *table) { PageEntry::set((qword)table & addressMask_4kb, EntryAttributes(writeAccessBit | userPageBit)); }
 };
 
+// pages whose translation changed during one mapping operation; they are dropped from the TLB together at the end
+class InvalidationList
+{
+public:
+	// above this many pages, the whole TLB is flushed instead
+	static constexpr byte capacity = 32;
+
+private:
+	qword pages[capacity];
+	byte count = 0;
+	bool overflow = false;
+
+public:
+	inline void add(qword virtualAddress, qword len)
+	{
+		if (overflow)
+			return;
+		if (len > (qword)(capacity - count) * 0x1000)
+		{
+			overflow = true;
+			return;
+		}
+		for (qword offset = 0; offset < len; offset += 0x1000)
+			pages[count++] = virtualAddress + offset;
+	}
+	// only for the paging that is loaded
+	void flush();
+	// drop every TLB entry, global ones included
+	static void flushAll();
+};
+
 class PageTable
 {
 public:
@@ -159,9 +216,9 @@ public:
 	PageTableEntry entries[PageEntry::entriesPerTable];
 
 	// map a region of virtual space to a continuous block of physical space
-	bool mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes);
+	bool mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes, InvalidationList *invalidations = nullptr);
 	// completely unmap a region of virtual space
-	bool unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len);
+	bool unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len, InvalidationList *invalidations = nullptr);
 
 	// check if region has any dirty page; unmapped pages are not considered dirty
 	bool dirtyRegion(qword virtualAddress, qword len);
@@ -182,9 +239,9 @@ public:
 	PageDirectoryEntry entries[PageEntry::entriesPerTable];
 
 	// map a region of virtual space to a continuous block of physical space
-	bool mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes);
+	bool mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes, InvalidationList *invalidations = nullptr);
 	// completely unmap a region of virtual space
-	bool unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len);
+	bool unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len, InvalidationList *invalidations = nullptr);
 
 	// check if region has any dirty page; unmapped pages are not considered dirty
 	bool dirtyRegion(dword virtualAddress, dword len);
@@ -201,13 +258,15 @@ class PageDirectoryPointerTable
 {
 public:
 	static constexpr qword bytesPerEntry = (qword)1 << 30;
+	// 1GB pages are only used if the cpu supports them; otherwise aligned ranges get 2MB pages
+	static bool bigPagesEnabled;
 
 	PageDirectoryPointerTableEntry entries[PageEntry::entriesPerTable];
 
 	// map a region of virtual space to a continuous block of physical space
-	bool mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes);
+	bool mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes, InvalidationList *invalidations = nullptr);
 	// completely unmap a region of virtual space
-	bool unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len);
+	bool unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len, InvalidationList *invalidations = nullptr);
 
 	// check if region has any dirty page; unmapped pages are not considered dirty
 	bool dirtyRegion(dword virtualAddress, dword len);
@@ -220,12 +279,18 @@ public:
 };
 class PageMapLevel4
 {
+	bool mapEntries(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes, InvalidationList &invalidations);
+	bool unmapEntries(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len, InvalidationList &invalidations);
+
 public:
 	static constexpr qword bytesPerEntry = (qword)1 << 39;
+	// the upper half of every address space belongs to the kernel
+	static constexpr word kernelEntriesStart = PageEntry::entriesPerTable / 2;
 
 	PageMapLevel4Entry entries[PageEntry::entriesPerTable];
 
-	// map a region of virtual space to a continuous block of physical space
+	// map a region of virtual space to a continuous block of physical space;
+	// changed translations are invalidated once at the end, if this is the loaded paging
 	bool mapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes);
 	// completely unmap a region of virtual space
 	bool unmapRegion(void *pageSpace, dword &pageAllocationMap, qword virtualAddress, qword len);
@@ -238,15 +303,53 @@ public:
 
 	// get the physical address that a virtual address translates to
 	bool getPhysicalAddress(qword virtualAddress, qword &physicalAddress, bool isUserAccess = false);
+	// get the entry that maps a 4KB page; nullptr if the page is not mapped, or it is part of a big page and split is false
+	PageTableEntry *getPageTableEntry(qword virtualAddress, bool split = false);
+	// get the entry of a 4KB page that is in the swap file; nullptr if the page is not swapped out
+	PageTableEntry *getSwappedEntry(qword virtualAddress);
+	// get the table that maps the 2MB block containing virtualAddress; nullptr if the block is not mapped or is a big page
+	PageTable *getPageTable(qword virtualAddress);
+
+	// the kernel code always runs with kernelPaging loaded, since interrupt entry switches to it
+	bool isLoaded();
+
+	// use the upper half tables of another pml4, so that changes made to them are visible in both
+	void shareKernelHalf(PageMapLevel4 &kernel);
+	// forget the shared upper half before clearAll, which would otherwise free the kernel tables
+	void unshareKernelHalf();
 
 	static PageMapLevel4 *create(void *pageSpace, dword &pageAllocationMap);
+
+	// the same operations, with the paging structures allocated from the page frame allocator
+	inline bool mapRegion(qword virtualAddress, qword physicalAddress, qword len, PageEntry::EntryAttributes attributes)
+	{
+		dword unused = 0;
+		return mapRegion(nullptr, unused, virtualAddress, physicalAddress, len, attributes);
+	}
+	inline bool unmapRegion(qword virtualAddress, qword len)
+	{
+		dword unused = 0;
+		return unmapRegion(nullptr, unused, virtualAddress, len);
+	}
+	inline void clearAll()
+	{
+		dword unused = 0;
+		clearAll(nullptr, unused);
+	}
+	inline static PageMapLevel4 *create()
+	{
+		dword unused = 0;
+		return create(nullptr, unused);
+	}
+	// the pml4 pointed to by a CR3 value, without the PCID and the flags
+	inline static PageMapLevel4 *fromCR3(qword cr3) { return (PageMapLevel4 *)(cr3 & PageEntry::addressMask_4kb); }
 	inline static PageMapLevel4 &getCurrent()
 	{
-		PageMapLevel4 *retVal;
+		qword retVal;
 		asm volatile(
-			"mov %[pml4], cr3"
-			: [pml4] "=r"(retVal));
-		return *retVal;
+			"mov %[cr3], cr3"
+			: [cr3] "=r"(retVal));
+		return *fromCR3(retVal);
 	}
 	inline void setAsCurrent()
 	{
@@ -257,4 +360,7 @@ public:
 	}
 };
 
+// the paging of the kernel task, loaded on interrupt entry
+extern PageMapLevel4 *kernelPaging;
+
 void PagingTest();
\ No newline at end of file
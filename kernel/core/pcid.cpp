@@ -0,0 +1,115 @@
+#include "pcid.h"
+#include "../cpu/cpuid.h"
+#include "paging.h"
+#include <iostream.h>
+#include "../debug/verbose.h"
+
+using namespace std;
+
+// or-ed to every CR3 value saved and loaded on interrupt entry and exit
+extern "C" qword cr3NoFlush;
+
+namespace PCID
+{
+	static constexpr dword cpuidPCIDBit = 1 << 17,		 // cpuid 1, ecx
+						   cpuidINVPCIDBit = 1 << 10;	 // cpuid 7, ebx
+	static constexpr qword cr4PCIDEnableBit = 1 << 17;
+
+	bool enabled = false;
+	// bit i is set if PCID i is in use
+	qword allocationMap[count / 64];
+
+	class InvpcidDescriptor
+	{
+	public:
+		qword pcid, virtualAddress;
+	};
+	enum class InvpcidType : qword
+	{
+		individualAddress = 0,
+		singleContext = 1,
+	};
+	inline void invpcid(InvpcidType type, word pcid, qword virtualAddress)
+	{
+		InvpcidDescriptor descriptor{pcid, virtualAddress};
+		asm volatile(
+			"invpcid %[type], %[descriptor]"
+			:
+			: [type] "r"(type), [descriptor] "m"(descriptor)
+			: "memory");
+	}
+
+	void Initialize()
+	{
+		dword eax, ebx, ecx, edx;
+		cpuid(0, eax, ebx, ecx, edx);
+		dword maxLeaf = eax;
+		cpuid(1, eax, ebx, ecx, edx);
+		bool hasPCID = ecx & cpuidPCIDBit;
+		// leaves above the highest one return the data of another leaf
+		bool hasINVPCID = false;
+		if (maxLeaf >= 7)
+		{
+			cpuid(7, 0, eax, ebx, ecx, edx);
+			hasINVPCID = ebx & cpuidINVPCIDBit;
+		}
+		if (!hasPCID || !hasINVPCID)
+		{
+			VERBOSE_LOG("PCID or INVPCID not supported, every address space switch flushes the TLB\n");
+			return;
+		}
+
+		for (qword &bits : allocationMap)
+			bits = 0;
+		allocationMap[0] = 1 << kernelPCID;
+
+		// the kernel paging is loaded, with PCID 0 in the low bits of CR3 as required
+		qword cr4;
+		asm volatile("mov %[cr4], cr4" : [cr4] "=r"(cr4));
+		cr4 |= cr4PCIDEnableBit;
+		asm volatile("mov cr4, %[cr4]" : : [cr4] "r"(cr4));
+
+		cr3NoFlush = noFlushBit;
+		enabled = true;
+	}
+	bool isEnabled() { return enabled; }
+
+	word Allocate()
+	{
+		if (!enabled)
+			return kernelPCID;
+		for (word i = 0; i < count / 64; i++)
+			if (~allocationMap[i])
+			{
+				word bit = __builtin_ctzll(~allocationMap[i]);
+				word pcid = i * 64 + bit;
+				if (pcid == sharedPCID)
+					break;
+				allocationMap[i] |= (qword)1 << bit;
+				return pcid;
+			}
+		return sharedPCID;
+	}
+	void Release(word pcid)
+	{
+		if (!enabled || pcid == kernelPCID || pcid == sharedPCID)
+			return;
+		// the next owner must not see the translations of this one
+		InvalidateAll(pcid);
+		allocationMap[pcid / 64] &= ~((qword)1 << (pcid % 64));
+	}
+
+	void Invalidate(word pcid, qword virtualAddress)
+	{
+		if (enabled)
+			invpcid(InvpcidType::individualAddress, pcid, virtualAddress);
+	}
+	void InvalidateAll(word pcid)
+	{
+		if (enabled)
+			invpcid(InvpcidType::singleContext, pcid, 0);
+	}
+
+	qword getCR3(void *pml4, word pcid) { return (qword)pml4 | pcid; }
+	qword getKernelCR3() { return (qword)kernelPaging | (enabled ? noFlushBit : 0); }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <types.h>
+
+// process context identifiers: each address space gets its own tag in the TLB, so that switching
+// between them does not flush the translations of the others
+// PCIDs are only used when INVPCID is supported too, since changed pages of a task have to be
+// invalidated while the kernel paging is loaded
+namespace PCID
+{
+	// the kernel paging always uses PCID 0
+	static constexpr word kernelPCID = 0, count = 0x1000;
+	// given out when every other PCID is in use; it is flushed every time a task using it is switched to
+	static constexpr word sharedPCID = count - 1;
+	// bit 63 of CR3: keep the TLB entries of the new PCID
+	static constexpr qword noFlushBit = (qword)1 << 63;
+
+	void Initialize();
+	bool isEnabled();
+
+	// returns kernelPCID if PCIDs are not enabled
+	word Allocate();
+	void Release(word pcid);
+
+	// remove a page from the TLB entries of a PCID
+	void Invalidate(word pcid, qword virtualAddress);
+	// remove every TLB entry of a PCID
+	void InvalidateAll(word pcid);
+
+	// the value to load in CR3 to switch to an address space
+	qword getCR3(void *pml4, word pcid);
+	qword getKernelCR3();
+}
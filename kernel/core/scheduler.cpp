@@ -1,4 +1,6 @@
 #include "scheduler.h"
+#include "swap.h"
+#include "stackpool.h"
 #include "../utils/time.h"
 #include <vector.h>
 #include "../cpu/gdt.h"
@@ -18,8 +20,36 @@ namespace Scheduler
 	ull currentThread;
 
 	bool enabled = false, idling = false;
+	Task *kernelTask;
 
 	extern "C" void idleTask();
+	// the idle task gets a stack of its own, the one of the last thread may belong to a user task
+	byte *idleStack;
+	// taken from the allocator by the idle task; it is zeroed again if the idle task is restarted before it is done
+	void *frameBeingZeroed = nullptr;
+
+	// called by the idle task in a loop; returns false once there is nothing left to do before halting
+	extern "C" bool idleWork()
+	{
+		disableInterrupts();
+		// under memory pressure, the pool would only take frames that are about to be reclaimed
+		// the frames for stack faults are taken here, where the frame allocator is not in use
+		StackPool::Refill();
+		if (frameBeingZeroed == nullptr && !PageFrame::isZeroPoolFull() && PageFrame::getFreeMemory() >= Swap::lowWatermark)
+			frameBeingZeroed = PageFrame::Allocate();
+		void *frame = frameBeingZeroed;
+		enableInterrupts();
+		if (frame == nullptr)
+			return false;
+
+		PageFrame::ZeroFrame(frame);
+
+		disableInterrupts();
+		PageFrame::AddZeroed(frame);
+		frameBeingZeroed = nullptr;
+		enableInterrupts();
+		return true;
+	}
 
 	void enable()
 	{
@@ -34,7 +64,8 @@ namespace Scheduler
 
 	void Initialize()
 	{
-		Task *kernelTask = new Task(true);
+		kernelTask = new Task(true);
+		idleStack = StackPool::Allocate();
 		Thread *kernelMainThread = new Thread(kernelTask, registers_t());
 
 		executingThreads = new vector<Thread *>();
@@ -45,14 +76,27 @@ namespace Scheduler
 
 		enable();
 	}
+	void removeKernelThreads(vector<Thread *> *threads)
+	{
+		for (ull i = threads->getSize() - 1; i != (ull)-1; i--)
+			if (threads->at(i)->getParentTask() == kernelTask)
+			{
+				delete threads->at(i);
+				threads->erase(i);
+			}
+	}
 	void CleanUp()
 	{
 		disable();
 
 		// CleanUp is assumed to be called from kernalMainThread
 		Thread *kernelMainThread = getCurrentThread();
-		delete kernelMainThread;
 		executingThreads->erase(currentThread);
+		// kernel threads never exit on their own
+		removeKernelThreads(executingThreads);
+		removeKernelThreads(sleepingThreads);
+		removeKernelThreads(waitingThreads);
+		delete kernelMainThread;
 
 		if (executingThreads->getSize() > 0)
 			cout << "Executing threads left!\n";
@@ -65,6 +109,8 @@ namespace Scheduler
 		if (waitingThreads->getSize() > 0)
 			cout << "Blocked threads left!\n";
 		delete waitingThreads;
+
+		StackPool::Deallocate(idleStack);
 	}
 
 	void add(Thread *thread)
@@ -106,12 +152,6 @@ namespace Scheduler
 			Scheduler::preempt(regs, preemptReason::timeSliceEnded);
 			preempt_timer = preempt_interval;
 		}
-		if (idling)
-		{
-			regs.rip = (ull)idleTask;
-			regs.cs = 0x8;
-			regs.cr3 = &PageMapLevel4::getCurrent();
-		}
 	}
 
 	void wakeupBlockedThreads(Thread *blockingThread, int returnedValue)
@@ -261,7 +301,9 @@ namespace Scheduler
 				regs.rip = (ull)idleTask;
 				regs.cs = GDT::KERNEL_CS;
 				regs.ss = GDT::KERNEL_DS;
-				regs.cr3 = &PageMapLevel4::getCurrent();
+				regs.rsp = (qword)idleStack + Thread::stackSize;
+				regs.rflags |= 1 << 9;
+				regs.cr3 = PCID::getKernelCR3();
 			}
 		}
 		if (reason == preemptReason::taskExited)
@@ -351,17 +393,45 @@ namespace Scheduler
 
 		// do the cleanup if blockedThread is already dead
 	}
-	bool createThread(registers_t &regs)
+	Thread *createKernelThread(void (*entry)())
 	{
-		Thread *parentThread = getCurrentThread();
-
-		byte *stack = (byte *)Memory::Allocate(0x10000, 0x1000);
-		// WIP:
-		// stack will NOT be mapped into the virtual space of the parent task
-		// this means that this function only works for kernel task, where the heap is identity mapped
+		// only the top page is backed yet, the rest is mapped as the thread reaches it
+		byte *stack = StackPool::Allocate();
+		if (stack == nullptr)
+			return nullptr;
+
+		registers_t regs = registers_t();
+		regs.rip = (qword)entry;
+		regs.cs = GDT::KERNEL_CS;
+		regs.ss = GDT::KERNEL_DS;
+		// as if entry had been called
+		regs.rsp = (qword)stack + Thread::stackSize - sizeof(qword);
+		regs.cr3 = PCID::getKernelCR3();
+
+		Thread *thread = new Thread(kernelTask, regs, stack);
+		add(thread);
+		return thread;
+	}
 
-		Thread *thread = new Thread(parentThread->getParentTask(), regs, stack);
-		return true;
+	void collectTasks(vector<Thread *> *threads, vector<Task *> &tasks)
+	{
+		for (ull i = 0; i < threads->getSize(); i++)
+		{
+			Task *task = threads->at(i)->getParentTask();
+			if (task->isKernelTask() || task->isDead())
+				continue;
+			bool found = false;
+			for (ull j = 0; j < tasks.getSize() && !found; j++)
+				found = tasks[j] == task;
+			if (!found)
+				tasks.push_back(task);
+		}
+	}
+	void getTasks(vector<Task *> &tasks)
+	{
+		collectTasks(executingThreads, tasks);
+		collectTasks(sleepingThreads, tasks);
+		collectTasks(waitingThreads, tasks);
 	}
 
 	Thread *getCurrentThread() { return currentThread == noExecutingThread ? nullptr : executingThreads->at(currentThread); }
@@ -19,6 +19,10 @@ namespace Scheduler
 	void CleanUp();
 
 	void add(Thread *thread);
+	// start a thread of the kernel task at entry, with a stack of its own; entry must never return
+	Thread *createKernelThread(void (*entry)());
+	// collect the user tasks that have threads; interrupts have to be disabled while the tasks are used
+	void getTasks(std::vector<Task *> &tasks);
 
 	void kill(Task *task, int returnedValue);
 	void kill(Thread *thread, int returnedValue);
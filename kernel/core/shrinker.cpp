@@ -0,0 +1,65 @@
+#include "shrinker.h"
+#include "pageframe.h"
+#include <iostream.h>
+#include "../cpu/interrupt/idt.h"
+#include <math.h>
+
+using namespace std;
+
+namespace Shrinker
+{
+	Shrinker shrinkers[maxShrinkerCount];
+	// objects freed by each shrinker
+	ull freedObjects[maxShrinkerCount];
+	byte shrinkerCount = 0;
+	ull shrinkCount = 0;
+
+	bool Register(const Shrinker &shrinker)
+	{
+		if (shrinkerCount == maxShrinkerCount)
+			return false;
+		freedObjects[shrinkerCount] = 0;
+		shrinkers[shrinkerCount++] = shrinker;
+		return true;
+	}
+
+	bool Shrink(qword size)
+	{
+		// the heap can run out in an interrupt as well as in a thread, so the previous state is restored
+		bool interruptsEnabled = saveAndDisableInterrupts();
+
+		shrinkCount++;
+		// the new arena needs some room for its bookkeeping too
+		size = alignValueUpwards(size, PageFrame::frameSize) + PageFrame::frameSize;
+		ull counts[maxShrinkerCount];
+		qword total = 0;
+		for (byte i = 0; i < shrinkerCount; i++)
+		{
+			counts[i] = shrinkers[i].count();
+			total += counts[i] * shrinkers[i].objectSize;
+		}
+
+		qword freed = 0;
+		for (byte i = 0; i < shrinkerCount && total > 0; i++)
+		{
+			if (counts[i] == 0)
+				continue;
+			ull objects = counts[i];
+			if (size < total)
+				objects = integerCeilDivide(counts[i] * shrinkers[i].objectSize * size / total, shrinkers[i].objectSize);
+			ull scanned = shrinkers[i].scan(objects);
+			freedObjects[i] += scanned;
+			freed += scanned * shrinkers[i].objectSize;
+		}
+
+		restoreInterrupts(interruptsEnabled);
+		return freed > 0;
+	}
+
+	void DisplaySummary()
+	{
+		cout << "Shrink requests: " << shrinkCount << '\n';
+		for (byte i = 0; i < shrinkerCount; i++)
+			cout << shrinkers[i].name << ": " << shrinkers[i].count() << " objects of " << shrinkers[i].objectSize << " bytes, " << freedObjects[i] << " freed\n";
+	}
+}
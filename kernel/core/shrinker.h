@@ -0,0 +1,29 @@
+#pragma once
+#include <types.h>
+
+// caches of the kernel register a shrinker, so that the memory they hold can be taken back when the heap
+// cannot grow anymore; every cache gives back a part of what it holds, in proportion to its size
+namespace Shrinker
+{
+	class Shrinker
+	{
+	public:
+		const char *name;
+		// number of objects the cache could free right now
+		ull (*count)();
+		// free up to count objects; returns how many were freed
+		ull (*scan)(ull count);
+		// bytes given back by freeing one object
+		qword objectSize;
+	};
+
+	static constexpr byte maxShrinkerCount = 16;
+
+	// shrinkers run with interrupts disabled, from inside the allocation that failed:
+	// they must not allocate from the heap, and must leave their cache consistent for an interrupted user of it
+	bool Register(const Shrinker &shrinker);
+	// ask every cache for its share of size bytes; returns false if nothing was freed
+	bool Shrink(qword size);
+
+	void DisplaySummary();
+}
@@ -0,0 +1,176 @@
+#include "stackpool.h"
+#include "thread.h"
+#include "pageframe.h"
+#include "paging.h"
+#include "shrinker.h"
+#include "../cpu/interrupt/idt.h"
+#include <iostream.h>
+
+using namespace std;
+
+namespace StackPool
+{
+	static constexpr qword guardSize = slotSize - Thread::stackSize;
+
+	void *reserve[reserveSize];
+	byte reserveCount = 0;
+	// exited stacks that still have their top page
+	word pooled[poolSize];
+	word pooledCount = 0;
+	// slots that were given back without any page; the ones from nextSlot upwards were never used
+	word unusedSlots[maxStackCount];
+	word unusedCount = 0, nextSlot = 0;
+	// one bit per slot that holds the stack of a thread; only those take faults
+	qword liveSlots[maxStackCount / 64];
+	bool shrinkerRegistered = false;
+
+	ull liveStacks = 0, committedPages = 0, faults = 0, overflows = 0, reuses = 0;
+
+	inline qword slotAddress(word slot) { return regionStart + slot * slotSize; }
+	inline qword stackTopPage(word slot) { return slotAddress(slot) + slotSize - PageFrame::frameSize; }
+	inline word slotOf(qword address) { return (address - regionStart) / slotSize; }
+	inline bool isLive(word slot) { return liveSlots[slot / 64] & ((qword)1 << (slot % 64)); }
+
+	bool commitPage(qword page, void *frame)
+	{
+		if (!kernelPaging->mapRegion(page, (qword)frame, PageFrame::frameSize, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::globalPageBit)))
+			return false;
+		committedPages++;
+		return true;
+	}
+	void decommitPage(qword page)
+	{
+		qword frame;
+		if (!kernelPaging->getPhysicalAddress(page, frame))
+			return;
+		kernelPaging->unmapRegion(page, PageFrame::frameSize);
+		committedPages--;
+		// the next stack fault can use it
+		if (reserveCount < reserveSize)
+			reserve[reserveCount++] = (void *)frame;
+		else
+			PageFrame::Deallocate((void *)frame);
+	}
+	// everything but the top page, which keeps the page table of the slot alive
+	void decommitDepth(word slot)
+	{
+		for (qword page = slotAddress(slot) + guardSize; page < stackTopPage(slot); page += PageFrame::frameSize)
+			decommitPage(page);
+	}
+
+	ull countPooled() { return pooledCount; }
+	ull shrinkPool(ull count)
+	{
+		bool interruptsEnabled = saveAndDisableInterrupts();
+		ull freed = 0;
+		for (; freed < count && pooledCount > 0; freed++)
+		{
+			word slot = pooled[--pooledCount];
+			decommitPage(stackTopPage(slot));
+			unusedSlots[unusedCount++] = slot;
+		}
+		restoreInterrupts(interruptsEnabled);
+		return freed;
+	}
+
+	byte *Allocate()
+	{
+		bool interruptsEnabled = saveAndDisableInterrupts();
+		if (!shrinkerRegistered)
+			shrinkerRegistered = Shrinker::Register(Shrinker::Shrinker{"Pooled stacks", countPooled, shrinkPool, PageFrame::frameSize});
+		Refill();
+
+		word slot;
+		if (pooledCount > 0)
+		{
+			slot = pooled[--pooledCount];
+			reuses++;
+		}
+		else
+		{
+			if (unusedCount > 0)
+				slot = unusedSlots[--unusedCount];
+			else if (nextSlot < maxStackCount)
+				slot = nextSlot++;
+			else
+			{
+				restoreInterrupts(interruptsEnabled);
+				return nullptr;
+			}
+			// the top page is needed right away, and it brings the page table the faults map into
+			void *frame = PageFrame::Allocate();
+			if (frame == nullptr || !commitPage(stackTopPage(slot), frame))
+			{
+				if (frame != nullptr)
+					PageFrame::Deallocate(frame);
+				unusedSlots[unusedCount++] = slot;
+				restoreInterrupts(interruptsEnabled);
+				return nullptr;
+			}
+		}
+		liveSlots[slot / 64] |= (qword)1 << (slot % 64);
+		liveStacks++;
+		restoreInterrupts(interruptsEnabled);
+		return (byte *)(slotAddress(slot) + guardSize);
+	}
+	void Deallocate(byte *stack)
+	{
+		bool interruptsEnabled = saveAndDisableInterrupts();
+		word slot = slotOf((qword)stack);
+		liveSlots[slot / 64] &= ~((qword)1 << (slot % 64));
+		decommitDepth(slot);
+		if (pooledCount < poolSize)
+			pooled[pooledCount++] = slot;
+		else
+		{
+			decommitPage(stackTopPage(slot));
+			unusedSlots[unusedCount++] = slot;
+		}
+		liveStacks--;
+		restoreInterrupts(interruptsEnabled);
+	}
+
+	bool isStackAddress(qword address) { return address >= regionStart && address < regionStart + maxStackCount * slotSize; }
+	bool isGuardAddress(qword address) { return isStackAddress(address) && (address - regionStart) % slotSize < guardSize; }
+
+	bool HandlePageFault(qword address)
+	{
+		if (!isStackAddress(address))
+			return false;
+		if (isGuardAddress(address))
+		{
+			overflows++;
+			return false;
+		}
+		// a stray access to a pooled or unused stack is reported, not covered up
+		if (!isLive(slotOf(address)))
+			return false;
+		qword page = address & ~(PageFrame::frameSize - 1);
+		// the top page of a live stack is always mapped, so the page table is there and mapping allocates nothing
+		if (reserveCount == 0 || kernelPaging->getPageTable(page) == nullptr)
+			return false;
+		if (!commitPage(page, reserve[reserveCount - 1]))
+			return false;
+		reserveCount--;
+		faults++;
+		return true;
+	}
+	void Refill()
+	{
+		while (reserveCount < reserveSize)
+		{
+			void *frame = PageFrame::Allocate();
+			if (frame == nullptr)
+				break;
+			reserve[reserveCount++] = frame;
+		}
+	}
+
+	void DisplaySummary()
+	{
+		cout << "Live stacks: " << liveStacks << ", pooled: " << pooledCount << ", slots used: " << nextSlot << '/' << maxStackCount << '\n';
+		cout << "Committed: " << committedPages * PageFrame::frameSize / 1024 << "KB, fully committed would be " << (liveStacks + pooledCount) * Thread::stackSize / 1024 << "KB\n";
+		cout << "Pages faulted in: " << faults << ", reserve: " << reserveCount << '/' << reserveSize << '\n';
+		cout << "Stacks reused: " << reuses << ", overflows caught: " << overflows << '\n';
+	}
+}
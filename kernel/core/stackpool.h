@@ -0,0 +1,34 @@
+#pragma once
+#include <types.h>
+
+// the stacks of kernel threads live in a range of virtual memory of their own: a stack only gets frames for the
+// pages its thread has touched, the others are mapped on the first fault, and an unmapped guard below every stack
+// catches overflows; the stacks of exited threads are kept in a pool for the next threads
+namespace StackPool
+{
+	// in the upper half, which all address spaces share
+	static constexpr qword regionStart = 0xFFFFFFFF00000000;
+	// every stack sits at the top of its slot, the rest of the slot is the guard;
+	// slots are aligned to their size, so a slot never straddles two page tables
+	static constexpr qword slotSize = 0x20000;
+	static constexpr word maxStackCount = 512;
+	// frames kept aside for stack faults, which can happen while the frame allocator itself is in use
+	static constexpr byte reserveSize = 32;
+	// exited stacks kept with their top page, ready for the next thread
+	static constexpr word poolSize = 64;
+
+	// returns the lowest address of a stack of Thread::stackSize bytes, whose top page is mapped;
+	// nullptr if there is no slot or no frame left
+	byte *Allocate();
+	void Deallocate(byte *stack);
+
+	bool isStackAddress(qword address);
+	bool isGuardAddress(qword address);
+	// from the page fault handler: map a frame from the reserve to the page of a stack that contains address;
+	// returns false for a guard page, or if the reserve is empty
+	bool HandlePageFault(qword address);
+	// take frames for the reserve from the frame allocator; interrupts have to be disabled
+	void Refill();
+
+	void DisplaySummary();
+}
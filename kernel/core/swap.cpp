@@ -0,0 +1,249 @@
+#include "swap.h"
+#include "task.h"
+#include "scheduler.h"
+#include "pageframe.h"
+#include "filesystem/filesystem.h"
+#include "mem.h"
+#include <iostream.h>
+#define OMIT_FUNCS
+#include <syscall.h>
+
+using namespace std;
+using namespace Filesystem;
+
+namespace Swap
+{
+	class ColdPage
+	{
+	public:
+		Task *task;
+		qword address;
+	};
+
+	string16 *path = nullptr;
+	bool enabled = false;
+	// one entry per page of the swap file; only accessed with interrupts disabled
+	bool *usedSlots = nullptr;
+	ull slotCount = 0, usedCount = 0, nextSlot = 0;
+	ull pagesOut = 0, pagesIn = 0, badSlots = 0;
+
+	bool allocateSlot(qword &slot)
+	{
+		if (usedCount == slotCount)
+			return false;
+		while (usedSlots[nextSlot])
+			nextSlot = (nextSlot + 1) % slotCount;
+		slot = nextSlot;
+		usedSlots[slot] = true;
+		usedCount++;
+		return true;
+	}
+	void Free(qword slot)
+	{
+		if (slot >= slotCount || !usedSlots[slot])
+			return;
+		usedSlots[slot] = false;
+		usedCount--;
+	}
+	// a slot that could not be written stays used, so that it is not tried again
+	void retireSlot(qword slot)
+	{
+		if (!usedSlots[slot])
+		{
+			usedSlots[slot] = true;
+			usedCount++;
+		}
+		badSlots++;
+	}
+
+	// a task that was not in the lists of the scheduler may be deleted as soon as interrupts are enabled
+	bool isAlive(Task *task)
+	{
+		vector<Task *> tasks;
+		Scheduler::getTasks(tasks);
+		for (Task *t : tasks)
+			if (t == task)
+				return true;
+		return false;
+	}
+
+	// the pager may be looking at the slots already, so they are only published once they are ready
+	void enable(ull length)
+	{
+		ull count = length / PageFrame::frameSize;
+		if (count == 0)
+			return;
+		bool *slots = new bool[count];
+		for (ull i = 0; i < count; i++)
+			slots[i] = false;
+		disableInterrupts();
+		usedSlots = slots;
+		slotCount = count;
+		enabled = true;
+		enableInterrupts();
+	}
+	bool findPath()
+	{
+		if (path != nullptr)
+			return true;
+		string letters = partitionList();
+		if (letters.length() == 0)
+			return false;
+		path = new string16((char16_t)letters[0] + string16(u":/swap.sys"));
+		return true;
+	}
+
+	void Initialize()
+	{
+		ull length;
+		if (findPath() && GetFileLength(*path, length) == result::success)
+			enable(length);
+	}
+	bool Create(ull size)
+	{
+		if (enabled)
+		{
+			cout << "The swap file is in use already\n";
+			return false;
+		}
+		if (!findPath())
+		{
+			cout << "There is no partition for the swap file\n";
+			return false;
+		}
+		result res = CreateFile(*path);
+		if (res != result::success)
+		{
+			cout << "Could not create the swap file: " << resultAsString(res) << '\n';
+			return false;
+		}
+		// the whole file is made now, so that swapping never has to grow it
+		for (ull length = 0; length < size && res == result::success;)
+		{
+			length = size - length < createChunkSize ? size : length + createChunkSize;
+			res = SetFileLength(*path, length);
+		}
+		if (res != result::success)
+		{
+			cout << "Could not make the swap file " << size / 1024 << "KB long: " << resultAsString(res) << '\n';
+			RemoveFile(*path);
+			return false;
+		}
+		enable(size);
+		return enabled;
+	}
+	bool isEnabled() { return enabled; }
+	bool isMemoryLow() { return enabled && PageFrame::getFreeMemory() < lowWatermark; }
+
+	// returns false if the page could not be written out
+	bool swapOut(ColdPage &page)
+	{
+		disableInterrupts();
+		qword slot;
+		if (!allocateSlot(slot))
+		{
+			enableInterrupts();
+			return false;
+		}
+		void *frame = isAlive(page.task) ? page.task->swapOutPage(page.address, slot) : nullptr;
+		if (frame == nullptr)
+			Free(slot);
+		enableInterrupts();
+		if (frame == nullptr)
+			return true;
+
+		// the page is not mapped anymore, so its contents cannot change during the write
+		result res = WriteFileRange(*path, slot * PageFrame::frameSize, (byte *)frame, PageFrame::frameSize);
+
+		disableInterrupts();
+		if (res == result::success)
+		{
+			PageFrame::Deallocate(frame);
+			pagesOut++;
+		}
+		else
+		{
+			cout << "Could not write to the swap file: " << resultAsString(res) << '\n';
+			// the page goes back to the task; if the task released it in the meantime, the slot was freed along with it
+			if (!isAlive(page.task) || !page.task->swapInPage(page.address, slot, frame))
+				PageFrame::Deallocate(frame);
+			retireSlot(slot);
+		}
+		enableInterrupts();
+		return res == result::success;
+	}
+
+	void Reclaim()
+	{
+		if (!enabled)
+			return;
+		vector<ColdPage> pages;
+		disableInterrupts();
+		vector<Task *> tasks;
+		Scheduler::getTasks(tasks);
+		vector<qword> addresses;
+		for (Task *task : tasks)
+		{
+			task->findColdPages(addresses, pagesPerPass - pages.getSize());
+			for (qword address : addresses)
+				pages.push_back(ColdPage{task, address});
+			addresses.resize(0);
+			if (pages.getSize() == pagesPerPass)
+				break;
+		}
+		enableInterrupts();
+
+		for (ColdPage &page : pages)
+			if (PageFrame::getFreeMemory() >= 2 * lowWatermark || !swapOut(page))
+				break;
+	}
+
+	bool SwapIn(Task *task, qword address)
+	{
+		disableInterrupts();
+		qword slot;
+		bool swapped = task->getSwapSlot(address, slot);
+		enableInterrupts();
+		// another thread of the task may have brought the page back already
+		if (!swapped)
+			return true;
+
+		void *frame = PageFrame::Allocate();
+		if (frame == nullptr)
+		{
+			Reclaim();
+			frame = PageFrame::Allocate();
+			if (frame == nullptr)
+				return false;
+		}
+		result res = ReadFileRange(*path, slot * PageFrame::frameSize, (byte *)frame, PageFrame::frameSize);
+		if (res != result::success)
+		{
+			cout << "Could not read from the swap file: " << resultAsString(res) << '\n';
+			PageFrame::Deallocate(frame);
+			return false;
+		}
+
+		disableInterrupts();
+		if (task->swapInPage(address, slot, frame))
+		{
+			Free(slot);
+			pagesIn++;
+		}
+		else
+			PageFrame::Deallocate(frame);
+		enableInterrupts();
+		return true;
+	}
+
+	void DisplaySummary()
+	{
+		if (!enabled)
+		{
+			cout << "No swap file\n";
+			return;
+		}
+		cout << "Swap file: " << *path << ", " << usedCount << " of " << slotCount << " pages used\n";
+		cout << "Pages swapped out: " << pagesOut << ", swapped in: " << pagesIn << ", bad slots: " << badSlots << '\n';
+	}
+}
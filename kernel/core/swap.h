@@ -0,0 +1,36 @@
+#pragma once
+#include <types.h>
+
+class Task;
+
+// pages of user memory that were not accessed for a while are written to a swap file when memory runs low,
+// and read back when they are accessed again; since the disk can only be accessed from a thread, all of it
+// is done by the pager of the page cache
+namespace Swap
+{
+	// size of the swap file made by Create when no size is given
+	static constexpr ull defaultSize = 0x800000;
+	// the file is made longer by this much at a time, so that other threads can use the disk in between
+	static constexpr ull createChunkSize = 0x100000;
+	// pages are swapped out while less memory than this is free, until twice as much is
+	static constexpr qword lowWatermark = 0x400000;
+	// pages written out at most before the pager looks at its requests again
+	static constexpr ull pagesPerPass = 64;
+
+	// only from a thread: use the swap file of the first partition, if it has one
+	void Initialize();
+	// only from a thread: make a swap file of size bytes on the first partition and start using it
+	bool Create(ull size);
+	bool isEnabled();
+	bool isMemoryLow();
+
+	// only from a thread: write cold pages of the user tasks to the swap file until enough memory is free
+	void Reclaim();
+	// only from a thread: read back the page of a task that contains address;
+	// the task has to stay alive, which it does while one of its threads waits for the pager
+	bool SwapIn(Task *task, qword address);
+	// give back the slot of a page that was released while swapped out; interrupts have to be disabled
+	void Free(qword slot);
+
+	void DisplaySummary();
+}
@@ -4,6 +4,7 @@
 #include "scheduler.h"
 #include "mem.h"
 #include "../drivers/disk/disk.h"
+#include "filesystem/pagecache.h"
 
 using namespace std;
 
@@ -28,7 +29,7 @@ extern "C" void os_serviceHandler(registers_t &regs)
 	case SYSCALL_KEYBOARD:
 		return Keyboard::Syscall(regs);
 	case SYSCALL_FILESYSTEM:
-		break;
+		return Syscall_Filesystem(regs);
 	case SYSCALL_CURSOR:
 		return Syscall_Cursor(regs);
 	case SYSCALL_TIME:
@@ -64,6 +65,44 @@ void Syscall_Breakpoint(registers_t &regs)
 	}
 	disableInterrupts();
 }
+// length of the int 0x30 instruction, which is executed again by a thread that had to wait for a page
+static constexpr qword syscallInstructionLength = 2;
+
+// if part of a user string is in a page that is in a mapped file or in the swap file, block the thread until
+// the pager reads it; the syscall is made again afterwards, since the disk cannot be accessed from here
+bool requestUserString(registers_t &regs, qword address, ull left, bool dynamic)
+{
+	Task *task = Scheduler::getCurrentThread()->getParentTask();
+	while (left)
+	{
+		ull len = 0x1000 - (address & 0xfff);
+		if (len > left)
+			len = left;
+		qword physical;
+		if (!task->getPhysicalAddress(address, physical))
+		{
+			regs.rip -= syscallInstructionLength;
+			if (task->requestPage(regs, address))
+				return true;
+			// not a page the pager can read, the caller reports the error
+			regs.rip += syscallInstructionLength;
+			return false;
+		}
+		if (dynamic)
+		{
+			const char *str = (const char *)physical;
+			ull strLen = 0;
+			while (strLen < len && str[strLen])
+				strLen++;
+			if (strLen < len)
+				return false;
+		}
+		address += len;
+		left -= len;
+	}
+	return false;
+}
+
 void Syscall_Screen(registers_t &regs)
 {
 	switch (regs.rbx)
@@ -73,24 +112,49 @@ void Syscall_Screen(registers_t &regs)
 	case SYSCALL_SCREEN_PRINTSTR:
 	case SYSCALL_SCREEN_PRINTDYNSTR:
 	{
-		// get the physical address of the string from regs.rdi and the paging structures
-		qword physical;
-		bool user = (regs.cs & 0b11) == 0b11;
-		// check that the task has access to the  string
-		// to-do: check that the task has access to the ENTIRE string
-		if (!regs.cr3->getPhysicalAddress((qword)regs.rdi, physical, user))
+		bool user = (regs.cs & 0b11) == 0b11,
+			 dynamic = regs.rbx == SYSCALL_SCREEN_PRINTDYNSTR;
+		qword address = regs.rdi;
+		ull left = dynamic ? (ull)-1 : regs.rsi;
+		if (user && requestUserString(regs, address, left, dynamic))
+			return;
+
+		// print a page at a time, user pages are not continuous in physical memory
+		while (left)
 		{
-			// error
-			isrcout << "Syscall error: address \"0x" << ::std::ostream::base::hex << regs.rdi << "\" not mapped\n";
-			regs.rdi = (ull)-1;
-			return Scheduler::preempt(regs, Scheduler::preemptReason::taskExited);
-		}
-		// for now, everything is identity mapped, no translation from physical to kernel virtual space
-		
-		// get length
-		ull len = regs.rbx == SYSCALL_SCREEN_PRINTSTR ? regs.rsi : strlen((const char*)physical);
+			// get the physical address of the string from the paging structures,
+			// which also checks that the task has access to this part of the string
+			qword physical;
+			bool translated = user ? Scheduler::getCurrentThread()->getParentTask()->getPhysicalAddress(address, physical)
+								   : PageMapLevel4::fromCR3(regs.cr3)->getPhysicalAddress(address, physical, user);
+			if (!translated)
+			{
+				// error
+				isrcout << "Syscall error: address \"0x" << ::std::ostream::base::hex << address << "\" not mapped\n";
+				regs.rdi = (ull)-1;
+				return Scheduler::preempt(regs, Scheduler::preemptReason::taskExited);
+			}
+			// for now, everything is identity mapped, no translation from physical to kernel virtual space
+			const char *str = (const char *)physical;
 
-		return Screen::driver_print((const char *)physical, len);
+			ull len = 0x1000 - (address & 0xfff);
+			if (len > left)
+				len = left;
+			if (dynamic)
+			{
+				// stop at the terminator, if it is in this page
+				ull strLen = 0;
+				while (strLen < len && str[strLen])
+					strLen++;
+				if (strLen < len)
+					left = len = strLen;
+			}
+
+			Screen::driver_print(str, len);
+			address += len;
+			left -= len;
+		}
+		return;
 	}
 	case SYSCALL_SCREEN_PRINTCH:
 		return Screen::driver_print((char)regs.rdi);
@@ -100,6 +164,27 @@ void Syscall_Screen(registers_t &regs)
 		return Screen::driver_paint((byte)regs.rdi, (byte)regs.rsi, (Screen::Cell::Color)regs.rdx, (Screen::Cell::Color)regs.rcx);
 	}
 }
+void Syscall_Filesystem(registers_t &regs)
+{
+	switch (regs.rbx)
+	{
+	case SYSCALL_FILESYSTEM_MAPFILE:
+	{
+		Task *task = Scheduler::getCurrentThread()->getParentTask();
+		ull pathLength = regs.rsi;
+		char16_t buffer[Filesystem::PageCache::maxPathLength];
+		if (pathLength == 0 || pathLength > Filesystem::PageCache::maxPathLength || !task->copyFromUser(buffer, regs.rdi, pathLength * sizeof(char16_t)))
+		{
+			regs.rax = 0;
+			return;
+		}
+		// opening the file needs the disk, so the pager maps it and gives the address in rax
+		if (!Filesystem::PageCache::RequestMap(regs, buffer, pathLength, regs.rdx, regs.rcx))
+			regs.rax = 0;
+		return;
+	}
+	}
+}
 void Syscall_Cursor(registers_t &regs)
 {
 	switch (regs.rbx)
@@ -142,5 +227,15 @@ void Syscall_ProgEnv(registers_t &regs)
 		return (void)Scheduler::waitForThread(regs, (Thread *)regs.rdi);
 	case SYSCALL_PROGENV_CREATETHREAD:
 		return;
+	case SYSCALL_PROGENV_RESERVEMEMORY:
+	{
+		qword address;
+		Task *task = Scheduler::getCurrentThread()->getParentTask();
+		regs.rax = task->reserveRegion(regs.rdi, address) ? address : 0;
+		return;
+	}
+	case SYSCALL_PROGENV_RELEASEMEMORY:
+		regs.rax = Scheduler::getCurrentThread()->getParentTask()->releaseRegion(regs.rdi, regs.rsi);
+		return;
 	}
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "task.h"
 #include "filesystem/filesystem.h"
 #include "mem.h"
+#include "swap.h"
+#include "objectcache.h"
 #include <iostream.h>
 #include <math.h>
 #include "../cpu/gdt.h"
@@ -12,7 +14,35 @@ struct ExecutableFileHeader
 	ull entryPoint;
 };
 
-Task *Task::createTask(const std::string16 &executableFileName)
+class TaskTemplate
+{
+public:
+	string16 fileName;
+	Task *task;
+	registers_t regs;
+};
+// programs that were already loaded
+vector<TaskTemplate> *templates = nullptr;
+
+TypedObjectCache<Task> taskCache("Task", 16);
+
+void *Task::operator new(size_t size) { return taskCache.allocate(size); }
+void Task::operator delete(void *ptr, size_t size) { taskCache.deallocate(ptr, size); }
+
+PageMapLevel4 *Task::createAddressSpace()
+{
+	// the kernel image, the descriptor tables and the interrupt stacks are all in the upper half
+	PageMapLevel4 *paging = PageMapLevel4::create();
+	if (paging == nullptr)
+	{
+		cout << "Ran out of memory for the task.\n";
+		return nullptr;
+	}
+	paging->shareKernelHalf(*kernelPaging);
+	return paging;
+}
+
+Task *Task::loadTemplate(const std::string16 &executableFileName, registers_t &regs)
 {
 	byte *content;
 	ull len;
@@ -22,64 +52,541 @@ Task *Task::createTask(const std::string16 &executableFileName)
 		// cout << "Could not read file: " << Filesystem::resultAsString(res) << "\n";
 		return nullptr;
 	}
-	ull interruptStackISR_physicalAddress,
-		interruptStackIRQ_physicalAddress,
-		interruptStackSYSCALL_physicalAddress;
 
-	if (!PageMapLevel4::getCurrent().getPhysicalAddress(0xFFFFFFFF80081000, interruptStackISR_physicalAddress, false) ||
-		!PageMapLevel4::getCurrent().getPhysicalAddress(0xFFFFFFFF80083000, interruptStackIRQ_physicalAddress, false) ||
-		!PageMapLevel4::getCurrent().getPhysicalAddress(0xFFFFFFFF80085000, interruptStackSYSCALL_physicalAddress, false)
-	)
+	PageMapLevel4 *paging = createAddressSpace();
+	if (paging == nullptr)
 	{
-		cout << "Could not obtain physical address of interrupt stacks.\n";
-		delete[] content;
-		return nullptr;
-	}
-
-	byte *pageSpace = (byte *)Memory::Allocate(0x10000, 0x1000),
-		 *stack = (byte *)Memory::Allocate(0x10000, 0x1000),
-		 *heap = (byte *)Memory::Allocate(0x10000, 0x1000);
-	dword pageAllocationMap = 0xffff0000;
-
-	PageMapLevel4 *paging = PageMapLevel4::create(pageSpace, pageAllocationMap);
-	bool mappingFailed = false;
-	if (paging != nullptr)
-	{
-		if (!paging->mapRegion(pageSpace, pageAllocationMap, 0x100000, (qword)content, alignValueUpwards(len, 0x1000), PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit))) // page loaded code
-			mappingFailed = true;
-		if (!paging->mapRegion(pageSpace, pageAllocationMap, 0x40000, (ull)stack, 0x10000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit))) // page stack
-			mappingFailed = true;
-		if (!paging->mapRegion(pageSpace, pageAllocationMap, 0x7f0000000000, (ull)heap, 0x10000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit))) // page heap
-			mappingFailed = true;
-		if (!paging->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80000000, 0x0000, 0x80000, PageEntry::EntryAttributes(PageEntry::writeAccessBit))) // page kernel
-			mappingFailed = true;
-		// get interrupt stack physical address and map it
-		if (!paging->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80081000, interruptStackISR_physicalAddress, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit)))
-			mappingFailed = true;
-		if (!paging->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80083000, interruptStackIRQ_physicalAddress, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit)))
-			mappingFailed = true;
-		if (!paging->mapRegion(pageSpace, pageAllocationMap, 0xFFFFFFFF80085000, interruptStackSYSCALL_physicalAddress, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit)))
-			mappingFailed = true;
-	}
-
-	if (paging == nullptr || mappingFailed)
-	{
-		cout << "Ran out of space for the paging structure.\n";
-		delete[] pageSpace;
 		delete[] content;
-		delete[] stack;
-		delete[] heap;
 		return nullptr;
 	}
 	ExecutableFileHeader *header = (ExecutableFileHeader *)content;
-	registers_t regs;
-	regs.rip = header->entryPoint < 0x100000 ? 0x100000 : header->entryPoint;
+	regs.rip = header->entryPoint < userImageStart ? userImageStart : header->entryPoint;
 	regs.cs = GDT::USER_CS | 3;
-	regs.cr3 = paging;
-	regs.rbp = regs.rsp = 0x50000;
+	regs.cr3 = PCID::getCR3(paging, PCID::kernelPCID);
+	regs.rbp = regs.rsp = userStackTop;
 	regs.fs = regs.gs = regs.ss = GDT::USER_DS | 3;
 	regs.rflags = 0;
-	Task *task = new Task(false, pageSpace, pageAllocationMap, content, heap);
-	Thread *thread = new Thread(task, regs, stack);
+
+	Task *task = new Task(false, paging);
+	task->addRegion(VirtualRegion{userImageStart, alignValueUpwards(len, 0x1000), VirtualRegion::Type::image, content, len, nullptr, 0});
+	task->addRegion(VirtualRegion{userStackTop - userStackSize, userStackSize, VirtualRegion::Type::anonymous, nullptr, 0, nullptr, 0});
+
+	// every clone shares the image pages, so the file contents are not needed after they are copied in
+	// pages inside a big page are already committed
+	qword physicalAddress;
+	for (qword page = userImageStart; page < userImageStart + len; page += 0x1000)
+		if (!task->getPhysicalAddress(page, physicalAddress))
+		{
+			cout << "Ran out of memory for the task.\n";
+			delete task;
+			delete[] content;
+			return nullptr;
+		}
+	VirtualRegion *image = task->findRegion(userImageStart);
+	image->type = VirtualRegion::Type::anonymous;
+	image->source = nullptr;
+	image->sourceLength = 0;
+	delete[] content;
 	return task;
+}
+
+Task *Task::createTask(const std::string16 &executableFileName)
+{
+	if (templates == nullptr)
+		templates = new vector<TaskTemplate>();
+
+	TaskTemplate *found = nullptr;
+	for (TaskTemplate &t : *templates)
+		if (t.fileName == executableFileName)
+			found = &t;
+	if (found == nullptr)
+	{
+		TaskTemplate t;
+		t.fileName = executableFileName;
+		t.task = loadTemplate(executableFileName, t.regs);
+		if (t.task == nullptr)
+			return nullptr;
+		templates->push_back(t);
+		found = &(*templates)[templates->getSize() - 1];
+	}
+	return found->task->clone(found->regs);
+}
+void Task::forgetTemplates()
+{
+	if (templates == nullptr)
+		return;
+	for (TaskTemplate &t : *templates)
+		delete t.task;
+	templates->resize(0);
+}
+
+Task *Task::clone(const registers_t &regs)
+{
+	PageMapLevel4 *childPaging = createAddressSpace();
+	if (childPaging == nullptr)
+		return nullptr;
+
+	Task *child = new Task(false, childPaging);
+	child->pcid = PCID::Allocate();
+	child->regions = regions;
+	for (auto &region : regions)
+		if (region.type == VirtualRegion::Type::file)
+			Filesystem::PageCache::AddReference(region.file);
+	for (auto &region : regions)
+		for (qword page = region.start; page < region.start + region.length; page += 0x1000)
+		{
+			// file pages stay shared and writable
+			if (region.type == VirtualRegion::Type::file)
+			{
+				qword frame;
+				if (!paging->getPhysicalAddress(page, frame, true))
+					continue;
+				// a copy would not see the writes of the other tasks, so the page is left to fault in again
+				if (!PageFrame::Share((void *)frame))
+					continue;
+				if (!childPaging->mapRegion(page, frame, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit)))
+				{
+					PageFrame::Deallocate((void *)frame);
+					cout << "Ran out of memory for the task.\n";
+					delete child;
+					return nullptr;
+				}
+				continue;
+			}
+			// big pages are split, so that the tasks only copy the 4KB pages they write to
+			// tasks are cloned from templates, which are not scheduled and so never have pages swapped out
+			PageTableEntry *entry = paging->getPageTableEntry(page, true);
+			if (entry == nullptr)
+				continue;
+			qword frame = entry->getAddress();
+			// a frame that cannot take another owner is copied right away
+			if (!PageFrame::Share((void *)frame))
+			{
+				void *copy = PageFrame::Allocate();
+				if (copy == nullptr || !childPaging->mapRegion(page, (qword)copy, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit)))
+				{
+					if (copy != nullptr)
+						PageFrame::Deallocate(copy);
+					cout << "Ran out of memory for the task.\n";
+					delete child;
+					return nullptr;
+				}
+				memcpy(copy, (void *)frame, 0x1000);
+				continue;
+			}
+			// both tasks lose write access, the first one to write gets a copy
+			if (!childPaging->mapRegion(page, frame, 0x1000, PageEntry::EntryAttributes(PageEntry::userPageBit)))
+			{
+				PageFrame::Deallocate((void *)frame);
+				cout << "Ran out of memory for the task.\n";
+				delete child;
+				return nullptr;
+			}
+			entry->setCopyOnWrite(true);
+			invalidatePage(page);
+			childPaging->getPageTableEntry(page)->setCopyOnWrite(true);
+		}
+
+	registers_t childRegs = regs;
+	childRegs.cr3 = PCID::getCR3(childPaging, child->pcid);
+	new Thread(child, childRegs);
+	return child;
+}
+
+bool Task::reserveRegion(qword length, qword &address)
+{
+	if (m_isKernelTask || length == 0)
+		return false;
+	return placeRegion(VirtualRegion{0, alignValueUpwards(length, 0x1000), VirtualRegion::Type::anonymous, nullptr, 0, nullptr, 0}, address);
+}
+bool Task::mapFile(Filesystem::PageCache::File *file, qword offset, qword length, qword &address)
+{
+	if (m_isKernelTask || offset & 0xfff || offset >= file->length)
+		return false;
+	if (length == 0 || offset + length > file->length)
+		length = file->length - offset;
+	return placeRegion(VirtualRegion{0, alignValueUpwards(length, 0x1000), VirtualRegion::Type::file, nullptr, 0, file, offset}, address);
+}
+bool Task::placeRegion(VirtualRegion region, qword &address)
+{
+	// first fit between the regions already reserved
+	qword start = userRegionsStart;
+	ull i = 0;
+	for (; i < regions.getSize(); i++)
+	{
+		if (regions[i].start + regions[i].length <= start)
+			continue;
+		if (regions[i].start >= start + region.length)
+			break;
+		start = regions[i].start + regions[i].length;
+	}
+	if (start + region.length > userRegionsEnd)
+		return false;
+
+	region.start = start;
+	regions.insert(region, i);
+	address = start;
+	return true;
+}
+bool Task::releaseRegion(qword address, qword length)
+{
+	for (ull i = 0; i < regions.getSize(); i++)
+	{
+		VirtualRegion &region = regions[i];
+		if (region.start != address || region.length != alignValueUpwards(length, 0x1000))
+			continue;
+		releaseRegionPages(region);
+		paging->unmapRegion(region.start, region.length);
+		invalidateRange(region.start, region.length);
+		regions.erase(i);
+		return true;
+	}
+	return false;
+}
+void Task::releaseRegionPages(VirtualRegion &region)
+{
+	if (region.type == VirtualRegion::Type::file)
+		collectDirtyPages(region);
+	releasePages(region.start, region.length);
+	if (region.type == VirtualRegion::Type::file)
+		Filesystem::PageCache::Close(region.file);
+}
+void Task::releasePages(qword start, qword length)
+{
+	for (qword page = start; page < start + length; page += 0x1000)
+	{
+		qword physicalAddress;
+		PageTableEntry *swapped;
+		if (paging->getPhysicalAddress(page, physicalAddress, true))
+			PageFrame::Deallocate((void *)physicalAddress);
+		else if ((swapped = paging->getSwappedEntry(page)))
+			Swap::Free(swapped->getSwapSlot());
+	}
+}
+bool Task::addRegion(const VirtualRegion &region)
+{
+	ull i = 0;
+	while (i < regions.getSize() && regions[i].start < region.start)
+		i++;
+	if (i > 0 && regions[i - 1].start + regions[i - 1].length > region.start)
+		return false;
+	if (i < regions.getSize() && region.start + region.length > regions[i].start)
+		return false;
+	regions.insert(region, i);
+	return true;
+}
+Task::VirtualRegion *Task::findRegion(qword address)
+{
+	// binary search for the last region that starts before address
+	ull left = 0, right = regions.getSize();
+	while (left < right)
+	{
+		ull middle = (left + right) / 2;
+		if (regions[middle].start <= address)
+			left = middle + 1;
+		else
+			right = middle;
+	}
+	if (left == 0 || !regions[left - 1].contains(address))
+		return nullptr;
+	return &regions[left - 1];
+}
+void Task::fillFrame(VirtualRegion &region, byte *frame, qword address, qword length)
+{
+	if (region.type != VirtualRegion::Type::image)
+		return;
+	qword offset = address - region.start;
+	if (offset < region.sourceLength)
+		memcpy(frame, region.source + offset, region.sourceLength - offset < length ? region.sourceLength - offset : length);
+}
+bool Task::handlePageFault(qword address)
+{
+	VirtualRegion *region = findRegion(address);
+	if (region == nullptr)
+		return false;
+
+	if (region->type == VirtualRegion::Type::file)
+		return mapFilePage(*region, address);
+	// the page has to be read back by the pager
+	if (paging->getSwappedEntry(address))
+		return false;
+
+	// only the touched page is committed; the big page daemon collapses blocks once all of their pages are in use
+	qword page = address & ~(qword)0xfff;
+	byte *frame = (byte *)PageFrame::AllocateZeroed();
+	if (frame == nullptr)
+		return false;
+	fillFrame(*region, frame, page, 0x1000);
+
+	if (!paging->mapRegion(page, (qword)frame, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit)))
+	{
+		PageFrame::Deallocate(frame);
+		return false;
+	}
+	return true;
+}
+bool Task::mapFilePage(VirtualRegion &region, qword address)
+{
+	qword page = address & ~(qword)0xfff;
+	ull index = (page - region.start + region.fileOffset) / 0x1000;
+	if (index >= region.file->pageCount || region.file->pages[index] == nullptr)
+		return false;
+
+	byte *frame = region.file->pages[index];
+	// the page cache keeps its own reference to the frame
+	if (!PageFrame::Share(frame))
+		return false;
+	if (!paging->mapRegion(page, (qword)frame, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit)))
+	{
+		PageFrame::Deallocate(frame);
+		return false;
+	}
+	return true;
+}
+bool Task::requestPage(registers_t &regs, qword address)
+{
+	VirtualRegion *region = findRegion(address);
+	if (region == nullptr)
+		return false;
+	// the access is retried once the thread runs again
+	if (region->type != VirtualRegion::Type::file)
+		return paging->getSwappedEntry(address) && Filesystem::PageCache::RequestSwapIn(regs, address);
+	ull index = ((address & ~(qword)0xfff) - region->start + region->fileOffset) / 0x1000;
+	if (index >= region->file->pageCount || region->file->pages[index] != nullptr)
+		return false;
+	return Filesystem::PageCache::RequestPage(regs, region->file, index);
+}
+void Task::collectDirtyPages(VirtualRegion &region)
+{
+	for (qword page = region.start; page < region.start + region.length; page += 0x1000)
+	{
+		PageTableEntry *entry = paging->getPageTableEntry(page);
+		if (entry == nullptr || !entry->isDirty())
+			continue;
+		region.file->dirty[(page - region.start + region.fileOffset) / 0x1000] = true;
+		entry->clearDirty();
+		invalidatePage(page);
+	}
+}
+void Task::collectDirtyPages()
+{
+	for (auto &region : regions)
+		if (region.type == VirtualRegion::Type::file)
+			collectDirtyPages(region);
+}
+bool Task::handleCopyOnWrite(qword address)
+{
+	PageTableEntry *entry = paging->getPageTableEntry(address);
+	if (entry == nullptr || !entry->isCopyOnWrite() || !(entry->attributesByte() & PageEntry::userPageBit))
+		return false;
+
+	void *frame = (void *)entry->getAddress();
+	// the last owner of a page can simply write to it
+	if (!PageFrame::isShared(frame))
+	{
+		entry->setCopyOnWrite(false);
+		invalidatePage(address);
+		return true;
+	}
+	void *copy = PageFrame::Allocate();
+	if (copy == nullptr)
+		return false;
+	memcpy(copy, frame, 0x1000);
+	entry->set((qword)copy, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit));
+	invalidatePage(address);
+	PageFrame::Deallocate(frame);
+	return true;
+}
+bool Task::collapseBigPage(qword block)
+{
+	PageTable *table = paging->getPageTable(block);
+	if (table == nullptr)
+		return false;
+
+	// copy on write pages are shared with other tasks, so they have to stay where they are
+	PageEntry::EntryAttributes attributes(PageEntry::writeAccessBit | PageEntry::userPageBit);
+	for (PageTableEntry &entry : table->entries)
+		if (!entry.isPresent() || entry.isCopyOnWrite() || !(entry.attributes() == attributes))
+			return false;
+
+	dword unused = 0;
+	qword firstPage = table->entries[0].getAddress();
+	if (table->canBeCollapsed(nullptr, unused, block, firstPage, PageTable::bytesPerEntry, attributes))
+	{
+		// the frames are already in place, only the table goes away
+		if (!paging->mapRegion(block, firstPage, PageDirectory::bytesPerEntry, attributes))
+			return false;
+		invalidateRange(block, PageDirectory::bytesPerEntry);
+		return true;
+	}
+
+	byte *frame = (byte *)PageFrame::Allocate(bigPageOrder);
+	if (frame == nullptr)
+		return false;
+	// the table is freed by mapRegion
+	qword pages[PageEntry::entriesPerTable];
+	for (qword i = 0; i < PageEntry::entriesPerTable; i++)
+	{
+		pages[i] = table->entries[i].getAddress();
+		memcpy(frame + i * PageTable::bytesPerEntry, (void *)pages[i], PageTable::bytesPerEntry);
+	}
+	if (!paging->mapRegion(block, (qword)frame, PageDirectory::bytesPerEntry, attributes))
+	{
+		PageFrame::Deallocate(frame, bigPageOrder);
+		return false;
+	}
+	invalidateRange(block, PageDirectory::bytesPerEntry);
+	for (qword page : pages)
+		PageFrame::Deallocate((void *)page);
+	return true;
+}
+int Task::collapseBigPages(int maxCount)
+{
+	int count = 0;
+	for (auto &region : regions)
+	{
+		// file pages belong to the page cache
+		if (region.type == VirtualRegion::Type::file)
+			continue;
+		for (qword block = alignValueUpwards(region.start, PageDirectory::bytesPerEntry); block + PageDirectory::bytesPerEntry <= region.start + region.length && count < maxCount; block += PageDirectory::bytesPerEntry)
+			if (collapseBigPage(block))
+				count++;
+	}
+	return count;
+}
+void Task::findColdPages(vector<qword> &pages, ull maxCount)
+{
+	for (auto &region : regions)
+	{
+		// file pages belong to the page cache, which writes them back instead
+		if (region.type == VirtualRegion::Type::file || region.start + region.length <= coldScanAddress)
+			continue;
+		qword page = region.start > coldScanAddress ? region.start : coldScanAddress;
+		for (; page < region.start + region.length; page += 0x1000)
+		{
+			if (pages.getSize() == maxCount)
+			{
+				coldScanAddress = page;
+				return;
+			}
+			PageTable *table = paging->getPageTable(page);
+			if (table == nullptr)
+			{
+				// nothing is committed in the block, or it is a big page
+				page = (page & ~(PageDirectory::bytesPerEntry - 1)) + PageDirectory::bytesPerEntry - 0x1000;
+				continue;
+			}
+			PageTableEntry &entry = table->entries[(page >> 12) & 0x1ff];
+			if (!entry.isPresent() || entry.isCopyOnWrite() || PageFrame::isShared((void *)entry.getAddress()))
+				continue;
+			if (entry.isAccessed())
+			{
+				// the cpu only sets the bit again once the translation is dropped from the TLB
+				entry.clearAccessed();
+				invalidatePage(page);
+			}
+			else
+				pages.push_back(page);
+		}
+	}
+	// the next search starts over from the first region
+	coldScanAddress = 0;
+}
+void *Task::swapOutPage(qword address, qword slot)
+{
+	VirtualRegion *region = findRegion(address);
+	PageTableEntry *entry = paging->getPageTableEntry(address);
+	if (region == nullptr || region->type == VirtualRegion::Type::file || entry == nullptr ||
+		entry->isAccessed() || entry->isCopyOnWrite() || PageFrame::isShared((void *)entry->getAddress()))
+		return nullptr;
+	void *frame = (void *)entry->getAddress();
+	entry->setSwapped(slot);
+	invalidatePage(address);
+	return frame;
+}
+bool Task::getSwapSlot(qword address, qword &slot)
+{
+	PageTableEntry *entry = paging->getSwappedEntry(address);
+	if (entry == nullptr)
+		return false;
+	slot = entry->getSwapSlot();
+	return true;
+}
+bool Task::swapInPage(qword address, qword slot, void *frame)
+{
+	PageTableEntry *entry = paging->getSwappedEntry(address);
+	if (entry == nullptr || entry->getSwapSlot() != slot)
+		return false;
+	// entries that are not present are never in the TLB
+	entry->set((qword)frame, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit));
+	return true;
+}
+bool Task::getPhysicalAddress(qword virtualAddress, qword &physicalAddress, bool write)
+{
+	qword page = virtualAddress & ~(qword)0xfff;
+	CachedTranslation &cached = cachedTranslation(virtualAddress);
+	if (cached.virtualPage == page && (cached.writable || !write))
+	{
+		physicalAddress = cached.physicalPage | (virtualAddress & 0xfff);
+		return true;
+	}
+
+	if (!paging->getPhysicalAddress(virtualAddress, physicalAddress, true) && !handlePageFault(virtualAddress))
+		return false;
+	if (write)
+	{
+		PageTableEntry *entry = paging->getPageTableEntry(virtualAddress);
+		if (entry && entry->isCopyOnWrite() && !handleCopyOnWrite(virtualAddress))
+			return false;
+	}
+	if (!paging->getPhysicalAddress(virtualAddress, physicalAddress, true))
+		return false;
+	bool writable = write;
+	VirtualRegion *region = write ? findRegion(virtualAddress) : nullptr;
+	if (region && region->type == VirtualRegion::Type::file)
+	{
+		// the kernel writes through its own mapping, which leaves the dirty bit of the task clear;
+		// such writes are not cached, so that each of them marks the page
+		region->file->dirty[(page - region->start + region->fileOffset) / 0x1000] = true;
+		writable = false;
+	}
+	cached = CachedTranslation{page, physicalAddress & ~(qword)0xfff, writable};
+	return true;
+}
+bool Task::copyFromUser(void *destination, qword source, qword length)
+{
+	byte *dst = (byte *)destination;
+	while (length)
+	{
+		qword physicalAddress;
+		if (!getPhysicalAddress(source, physicalAddress))
+			return false;
+		qword len = 0x1000 - (source & 0xfff);
+		if (len > length)
+			len = length;
+		// RAM is identity mapped in the kernel
+		memcpy(dst, (void *)physicalAddress, len);
+		dst += len;
+		source += len;
+		length -= len;
+	}
+	return true;
+}
+bool Task::copyToUser(qword destination, const void *source, qword length)
+{
+	const byte *src = (const byte *)source;
+	while (length)
+	{
+		qword physicalAddress;
+		if (!getPhysicalAddress(destination, physicalAddress, true))
+			return false;
+		qword len = 0x1000 - (destination & 0xfff);
+		if (len > length)
+			len = length;
+		memcpy((void *)physicalAddress, src, len);
+		src += len;
+		destination += len;
+		length -= len;
+	}
+	return true;
 }
\ No newline at end of file
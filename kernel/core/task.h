@@ -1,5 +1,9 @@
 #pragma once
 #include "../cpu/interrupt/idt.h"
+#include "paging.h"
+#include "pageframe.h"
+#include "pcid.h"
+#include "filesystem/pagecache.h"
 #include <string.h>
 
 class Thread;
@@ -7,31 +11,155 @@ class Thread;
 
 class Task
 {
-	byte *pageSpace, *programImage, *heap;
+public:
+	// a range of the virtual space whose pages are only allocated when they are first accessed
+	class VirtualRegion
+	{
+	public:
+		enum class Type : byte
+		{
+			// zero-filled pages: stack, heap and other reserved memory
+			anonymous,
+			// pages filled from the program image
+			image,
+			// pages of a file in the page cache, shared with every task that maps the file
+			file,
+		};
+
+		qword start, length;
+		Type type;
+		// for image regions: the data the region is initialized with
+		byte *source;
+		qword sourceLength;
+		// for file regions: the file, and the offset in it where the region starts
+		Filesystem::PageCache::File *file;
+		qword fileOffset;
+
+		inline bool contains(qword address) { return address >= start && address < start + length; }
+	};
+
+	// the stack of the main thread grows down from userStackTop
+	static constexpr qword userImageStart = 0x100000,
+						   userStackTop = 0x50000,
+						   userStackSize = 0x10000;
+	// reserved regions are placed in this part of the user space
+	static constexpr qword userRegionsStart = 0x7f0000000000,
+						   userRegionsEnd = 0x7fff00000000;
+	// 2MB blocks whose pages are all committed are collapsed into a big page by the big page daemon
+	static constexpr byte bigPageOrder = 9;
+
+private:
+	PageMapLevel4 *paging;
+	// tag of the TLB entries of this address space; kernelPCID for tasks that never run
+	word pcid = PCID::kernelPCID;
+	byte *programImage;
 	std::vector<byte *> programResources;
+	// sorted by start address
+	std::vector<VirtualRegion> regions;
 	Thread *mainThread = nullptr;
 	int threadCount = 0;
-	dword pageAllocationMap;
+	// where the next search for cold pages starts, so that every page gets the same time to be accessed
+	qword coldScanAddress = 0;
 	bool m_isKernelTask, m_isDead = false;
 
+	// unmap the committed pages of a range and give their frames back
+	void releasePages(qword start, qword length);
+	// release the pages of a region, after saving which file pages were changed
+	void releaseRegionPages(VirtualRegion &region);
+	// user pages translated recently, so that syscalls don't walk the paging structures for every buffer;
+	// an entry is dropped whenever the TLB entry of its page is
+	class CachedTranslation
+	{
+	public:
+		qword virtualPage, physicalPage;
+		// the page was translated for a write, so it is not copy on write
+		bool writable;
+	};
+	static constexpr byte translationCacheSize = 16;
+	// never a page address
+	static constexpr qword noPage = 1;
+	CachedTranslation translationCache[translationCacheSize];
+
+	inline CachedTranslation &cachedTranslation(qword address) { return translationCache[(address >> 12) % translationCacheSize]; }
+	inline void clearTranslationCache()
+	{
+		for (CachedTranslation &entry : translationCache)
+			entry.virtualPage = noPage;
+	}
+	// drop a page whose mapping changed from the TLB, even if this task is not the current one
+	inline void invalidatePage(qword address)
+	{
+		CachedTranslation &cached = cachedTranslation(address);
+		if (cached.virtualPage == (address & ~(qword)0xfff))
+			cached.virtualPage = noPage;
+		if (pcid != PCID::kernelPCID)
+			PCID::Invalidate(pcid, address);
+	}
+	inline void invalidateRange(qword start, qword length)
+	{
+		// past a few pages, dropping every entry of the task is cheaper than one invalidation per page
+		if (length > InvalidationList::capacity * PageTable::bytesPerEntry)
+		{
+			clearTranslationCache();
+			if (pcid != PCID::kernelPCID)
+				PCID::InvalidateAll(pcid);
+		}
+		else
+			for (qword page = start; page < start + length; page += 0x1000)
+				invalidatePage(page);
+	}
+	// a new address space with the kernel mapped in it
+	static PageMapLevel4 *createAddressSpace();
+	// load a program into a task without threads, with its whole image committed, to be cloned by createTask
+	static Task *loadTemplate(const std::string16 &executableFileName, registers_t &regs);
+	// add a region, unless it overlaps one that already exists
+	bool addRegion(const VirtualRegion &region);
+	// place a region in the first free range of the reserved part of the user space
+	bool placeRegion(VirtualRegion region, qword &address);
+	// fill a new, zeroed frame with the initial contents of a part of a region
+	void fillFrame(VirtualRegion &region, byte *frame, qword address, qword length);
+	// map the page of a file region containing address, if the page cache has it
+	bool mapFilePage(VirtualRegion &region, qword address);
+	// mark the file pages written through this region as dirty in the page cache
+	void collectDirtyPages(VirtualRegion &region);
+	VirtualRegion *findRegion(qword address);
+
 public:
-	inline Task(bool isKernelTask = false, byte *pageSpace = nullptr, dword pageAllocationMap = 0xffff0000, byte *programImage = nullptr, byte *heap = nullptr)
-		: pageSpace(pageSpace), programImage(programImage), heap(heap), m_isKernelTask(isKernelTask), pageAllocationMap(pageAllocationMap)
+	inline Task(bool isKernelTask = false, PageMapLevel4 *paging = nullptr, byte *programImage = nullptr)
+		: paging(paging), programImage(programImage), m_isKernelTask(isKernelTask)
 	{
+		clearTranslationCache();
 	}
 	inline ~Task()
 	{
 		for (auto ptr : programResources)
 			delete[] ptr;
-		if (pageSpace)
-			delete[] pageSpace;
+		for (auto &region : regions)
+			releaseRegionPages(region);
+		if (pcid != PCID::kernelPCID)
+			PCID::Release(pcid);
+		if (paging)
+		{
+			paging->unshareKernelHalf();
+			paging->clearAll();
+			PageFrame::Deallocate(paging);
+		}
 		if (programImage)
 			delete[] programImage;
-		if (heap)
-			delete[] heap;
 	}
 
+	// tasks are created for every program started, their memory comes from an object cache
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr, size_t size);
+
+	// programs are loaded once and then started by cloning the loaded task
 	static Task *createTask(const std::string16 &executableFileName);
+	// drop the loaded programs, so that the next createTask reads them from disk again
+	static void forgetTemplates();
+
+	// create a task with a copy of this address space and a thread starting with regs;
+	// the committed pages are shared copy on write between the two tasks
+	Task *clone(const registers_t &regs);
 
 	inline bool isKernelTask() { return m_isKernelTask; }
 	inline Thread *getMainThread() { return mainThread; }
@@ -40,5 +168,45 @@ public:
 
 	inline void bindResource(byte *resource) { programResources.push_back(resource); }
 
+	// reserve a range of virtual space of at least length bytes
+	bool reserveRegion(qword length, qword &address);
+	// map length bytes of a file starting at offset, which has to be page aligned; length 0 maps the rest of the file
+	// the region takes over the reference to the file that the caller got from the page cache
+	bool mapFile(Filesystem::PageCache::File *file, qword offset, qword length, qword &address);
+	// release a range obtained from reserveRegion or mapFile, along with the pages committed in it
+	bool releaseRegion(qword address, qword length);
+	// allocate and map the page containing address, if it belongs to a region
+	bool handlePageFault(qword address);
+	// if address is in a page of a mapped file that was not read yet, or in a page that is swapped out,
+	// block the current thread until the pager reads it
+	bool requestPage(registers_t &regs, qword address);
+	// give a private, writable copy of a copy on write page to this task
+	bool handleCopyOnWrite(qword address);
+	// move the dirty bits of the mapped file pages to the page cache, so that the pager writes them back
+	void collectDirtyPages();
+	// map a 2MB block whose 4KB pages are all committed with a big page; if the pages are not
+	// physically continuous, they are moved to a new 2MB frame first
+	bool collapseBigPage(qword block);
+	// collapse up to maxCount blocks of the regions of this task; returns the number of collapsed blocks
+	int collapseBigPages(int maxCount);
+	// add to pages up to maxCount pages of anonymous and image regions that were not accessed since the last search,
+	// and clear the accessed bit of the others; copy on write and big pages are left in memory
+	void findColdPages(std::vector<qword> &pages, ull maxCount);
+	// mark a cold page as being in a slot of the swap file; returns its frame, which the caller writes out and frees,
+	// or nullptr if the page was accessed or released since it was found
+	void *swapOutPage(qword address, qword slot);
+	bool getSwapSlot(qword address, qword &slot);
+	// map the frame a swapped out page was read into, unless the page was released in the meantime
+	bool swapInPage(qword address, qword slot, void *frame);
+	// translate a user address, allocating its page if it was not accessed yet;
+	// if the kernel is about to write to the page, it gets its private copy first
+	// fails for file pages that were not read yet and for swapped out pages, since the disk cannot be accessed from an interrupt
+	bool getPhysicalAddress(qword virtualAddress, qword &physicalAddress, bool write = false);
+
+	// copy between a kernel buffer and the user space of this task, a page at a time;
+	// fails if any part of the user buffer is outside the regions of the task
+	bool copyFromUser(void *destination, qword source, qword length);
+	bool copyToUser(qword destination, const void *source, qword length);
+
 	friend Thread;
 };
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include "thread.h"
+#include "objectcache.h"
+#include "stackpool.h"
+
+TypedObjectCache<Thread> threadCache("Thread", 64);
 
 Thread::Thread(Task *parentTask, const registers_t &regs, byte *stack)
 	: parentTask(parentTask), regs(regs), stack(stack)
@@ -12,10 +16,27 @@ Thread::Thread(Task *parentTask, const registers_t &regs, byte *stack)
 Thread::~Thread()
 {
 	if (stack)
-		delete[] stack;
+		StackPool::Deallocate(stack);
 
 	if (--parentTask->threadCount == 0)
 		delete parentTask;
 }
 
+void *Thread::operator new(size_t size) { return threadCache.allocate(size); }
+void Thread::operator delete(void *ptr, size_t size) { threadCache.deallocate(ptr, size); }
+
+void Thread::switchContext(Thread *currentThread, Thread *targetThread, registers_t &regs)
+{
+	// save the state of the currentTask
+	if (currentThread)
+		currentThread->regs = regs;
+	// switch context to the selected task
+	regs = targetThread->regs;
+	// the shared PCID may hold the translations of another task
+	if (targetThread->parentTask->pcid == PCID::sharedPCID)
+		regs.cr3 &= ~PCID::noFlushBit;
+	// enable interrupts for the new task
+	regs.rflags |= 1 << 9;
+}
+
 bool Thread::IsMainThread() { return parentTask->mainThread == this; }
\ No newline at end of file
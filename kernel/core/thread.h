@@ -21,19 +21,16 @@ class Thread
 	ThreadActivationCondition activationCondition;
 
 public:
+	static constexpr qword stackSize = 0x10000;
+
 	Thread(Task *parentTask, const registers_t &regs, byte *stack = nullptr);
 	~Thread();
 
-	inline static void switchContext(Thread *currentThread, Thread *targetThread, registers_t &regs)
-	{
-		// save the state of the currentTask
-		if (currentThread)
-			currentThread->regs = regs;
-		// switch context to the selected task
-		regs = targetThread->regs;
-		// enable interrupts for the new task
-		regs.rflags |= 1 << 9;
-	}
+	// threads are created and destroyed all the time, their memory comes from an object cache
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr, size_t size);
+
+	static void switchContext(Thread *currentThread, Thread *targetThread, registers_t &regs);
 
 	inline Task *getParentTask() { return parentTask; }
 	inline registers_t &getRegs() { return regs; }
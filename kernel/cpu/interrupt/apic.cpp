@@ -79,10 +79,7 @@ namespace APIC
 
 		// map APIC registers
 		PageMapLevel4 &current = PageMapLevel4::getCurrent();
-		void *pageSpace;
-		dword *pageAllocationMap;
-		Memory::GetPageSpace(pageSpace, pageAllocationMap);
-		if (!current.mapRegion(pageSpace, *pageAllocationMap, (qword)localAPIC, (qword)localAPIC, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::pageWriteThroughBit | PageEntry::pageCacheDisable)))
+		if (!current.mapRegion((qword)localAPIC, (qword)localAPIC, 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::pageWriteThroughBit | PageEntry::pageCacheDisable)))
 		{
 			// handle error case
 			System::blueScreen();
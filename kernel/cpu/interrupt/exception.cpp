@@ -3,6 +3,7 @@
 #include "../../utils/isriostream.h"
 #include "pic.h"
 #include "../../core/scheduler.h"
+#include "../../core/stackpool.h"
 #include "../../core/sys.h"
 #include "../../debug/debug.h"
 
@@ -12,6 +13,11 @@ namespace Exception
 {
 	extern "C" qword getCR2();
 
+	// page fault error code bits
+	static constexpr qword pageFaultPresentBit = 1 << 0,
+						   pageFaultWriteBit = 1 << 1,
+						   pageFaultUserBit = 1 << 2;
+
 	const char *exceptionMessages[0x20] = {
 		"Divide by 0",
 		"Debug",
@@ -52,6 +58,27 @@ namespace Exception
 		if (int_no == 1 || int_no == 3)
 			return Debug::DebugExceptionHandler(regs, int_no);
 
+		// the stacks of kernel threads are only backed where they have been used; this runs on the exception stack
+		if (int_no == 0xe && (err_no & (pageFaultPresentBit | pageFaultUserBit)) == 0 && StackPool::HandlePageFault(getCR2()))
+			return;
+		// a user access to a page that is not present may be to a page that has not been allocated yet
+		if (int_no == 0xe && (err_no & pageFaultPresentBit) == 0 && (err_no & pageFaultUserBit) && Scheduler::isEnabled())
+		{
+			Thread *thread = Scheduler::getCurrentThread();
+			if (thread && thread->getParentTask()->handlePageFault(getCR2()))
+				return;
+			// a page of a mapped file or a swapped out page is read by the pager, the access is retried after that
+			if (thread && thread->getParentTask()->requestPage(regs, getCR2()))
+				return;
+		}
+		// a user write to a present, read-only page may be to a page shared copy on write
+		if (int_no == 0xe && (err_no & pageFaultPresentBit) && (err_no & pageFaultWriteBit) && (err_no & pageFaultUserBit) && Scheduler::isEnabled())
+		{
+			Thread *thread = Scheduler::getCurrentThread();
+			if (thread && thread->getParentTask()->handleCopyOnWrite(getCR2()))
+				return;
+		}
+
 		// if (int_no == 7 || int_no == 6)
 
 		isrcout
@@ -71,6 +98,8 @@ namespace Exception
 		{
 		case 0xe: // page fault
 			isrcout << "\nAccessing address: " << (void *)getCR2() << '\n';
+			if (StackPool::isGuardAddress(getCR2()))
+				isrcout << "Kernel thread stack overflow\n";
 			break;
 		}
 
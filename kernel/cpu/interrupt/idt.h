@@ -5,12 +5,32 @@
 extern "C" void disableInterrupts();
 extern "C" void enableInterrupts();
 
+// for code that runs both in interrupts and in threads: disable interrupts, and tell if they were enabled
+inline bool saveAndDisableInterrupts()
+{
+	qword flags;
+	asm volatile(
+		"pushfq\n"
+		"pop %0\n"
+		"cli"
+		: "=r"(flags)
+		:
+		: "memory");
+	return flags & (1 << 9);
+}
+inline void restoreInterrupts(bool enabled)
+{
+	if (enabled)
+		enableInterrupts();
+}
+
 struct registers_t
 {
 	qword rax, rbx, rcx, rdx, rdi, rsi, r8, r9,
 		r10, r11, r12, r13, r14, r15,
 		fs, gs, rbp;
-	PageMapLevel4 *cr3;
+	// address of the pml4, with the PCID and the no-flush bit
+	qword cr3;
 	qword rip, cs, rflags, rsp, ss;
 };
 
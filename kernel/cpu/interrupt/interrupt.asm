@@ -6,15 +6,17 @@
 ; symbols for .data
 global interruptNr
 global errCode
-global kernelPaging
+global cr3NoFlush
 
 errCode: dq 0
-kernelPaging: dq 0
+; set to the CR3 no-flush bit when PCIDs are enabled
+cr3NoFlush: dq 0
 interruptNr: db 0
 
 [section .text]
 
 ; externals for .text
+[extern kernelPaging]
 [extern exceptionHandler]
 [extern irqHandler]
 [extern irqApicHandler]
@@ -448,6 +450,8 @@ mov rax, cr2
 ret
 
 pushCpuState:
+; the interrupted code may have the direction flag set, compiled code expects it clear; iretq restores it
+cld
 push rbp
 lea rbp, [rsp + 8]
 push gs
@@ -468,8 +472,10 @@ push rbx
 push rax
 mov rax, [rbp]
 mov rdi, cr3
+or rdi, [cr3NoFlush]
 mov [rbp], rdi
 mov rdi, [kernelPaging]
+or rdi, [cr3NoFlush]
 mov cr3, rdi
 jmp rax
 
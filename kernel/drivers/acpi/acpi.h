@@ -3,6 +3,7 @@
 #include "fadt.h"
 #include "dsdt.h"
 #include "madt.h"
+#include "srat.h"
 #include "ssdt.h"
 #include "aml.h"
 #include <string.h>
@@ -12,6 +13,8 @@ namespace ACPI
 	void Initialize();
 	void CleanUp();
 
+	// find the root table; it does not use the heap, so it can run before Initialize
+	void LocateRootTable();
 	void listRootEntries();
 	GenericSDT* getTable(const char tableId[4]);
 
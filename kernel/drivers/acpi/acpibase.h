@@ -18,6 +18,8 @@ namespace ACPI
 
 		static constexpr char MADT[] = "APIC";
 		static constexpr char FADT[] = "FACP";
+		static constexpr char SRAT[] = "SRAT";
+		static constexpr char SLIT[] = "SLIT";
 	}
 
 	class SDTHeader
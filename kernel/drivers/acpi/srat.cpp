@@ -0,0 +1,210 @@
+#include "srat.h"
+#include "acpi.h"
+#include <iostream.h>
+using namespace std;
+
+namespace ACPI
+{
+	class SRAT : public GenericSDT
+	{
+	public:
+		class EntryGeneric
+		{
+		public:
+			enum EntryType : byte
+			{
+				processorAffinity = 0,
+				memoryAffinity = 1,
+				x2APICAffinity = 2,
+			} entryType;
+			byte recordLength;
+
+			inline EntryGeneric *next() { return (EntryGeneric *)((byte *)this + recordLength); }
+		};
+		class ProcessorAffinity : public EntryGeneric
+		{
+		public:
+			byte proximityDomainLow;
+			byte APICID;
+			UnalignedField<uint> flags; // bit 0: enabled
+			byte localSAPICEID;
+			byte proximityDomainHigh[3];
+			UnalignedField<uint> clockDomain;
+
+			inline uint getProximityDomain() { return proximityDomainLow | proximityDomainHigh[0] << 8 | proximityDomainHigh[1] << 16 | proximityDomainHigh[2] << 24; }
+		};
+		class MemoryAffinity : public EntryGeneric
+		{
+		public:
+			UnalignedField<uint> proximityDomain;
+		private:
+			word reserved1;
+		public:
+			UnalignedField<uint> baseLow, baseHigh, lengthLow, lengthHigh;
+		private:
+			uint reserved2;
+		public:
+			UnalignedField<uint> flags; // bit 0: enabled, bit 1: hot pluggable, bit 2: non-volatile
+		};
+		class X2APICAffinity : public EntryGeneric
+		{
+			word reserved1;
+		public:
+			UnalignedField<uint> proximityDomain;
+			UnalignedField<uint> x2APICID;
+			UnalignedField<uint> flags; // bit 0: enabled
+			UnalignedField<uint> clockDomain;
+		};
+
+	private:
+		uint reserved1;
+		qword reserved2;
+	public:
+		EntryGeneric entries[0];
+	};
+	class SLIT : public GenericSDT
+	{
+	public:
+		UnalignedField<qword> localityCount;
+		// localityCount * localityCount distances, by row
+		byte distances[0];
+	};
+
+	class NodeRange
+	{
+	public:
+		qword start, end;
+		byte node;
+	};
+	class ProcessorNode
+	{
+	public:
+		dword apicId;
+		byte node;
+	};
+	static constexpr byte maxRangeCount = 32, maxProcessorCount = 64;
+
+	SRAT *srat = nullptr;
+	SLIT *slit = nullptr;
+	// proximity domains in the order they were first seen; a node is an index in this array
+	uint nodeDomains[maxNodeCount];
+	byte nodeCount = 0;
+	NodeRange ranges[maxRangeCount];
+	byte rangeCount = 0;
+	ProcessorNode processors[maxProcessorCount];
+	byte processorCount = 0;
+
+	// domains past the last node are merged into it
+	byte getNode(uint proximityDomain)
+	{
+		for (byte i = 0; i < nodeCount; i++)
+			if (nodeDomains[i] == proximityDomain)
+				return i;
+		if (nodeCount == maxNodeCount)
+			return maxNodeCount - 1;
+		nodeDomains[nodeCount] = proximityDomain;
+		return nodeCount++;
+	}
+
+	void InitializeSRAT()
+	{
+		LocateRootTable();
+		srat = (SRAT *)getTable(TableId::SRAT);
+		if (srat == nullptr)
+			return; // not a NUMA system
+		slit = (SLIT *)getTable(TableId::SLIT);
+
+		for (SRAT::EntryGeneric *entry = srat->entries; srat->ContainsField(*entry) && entry->recordLength; entry = entry->next())
+			switch (entry->entryType)
+			{
+			case SRAT::EntryGeneric::processorAffinity:
+			{
+				SRAT::ProcessorAffinity *processor = (SRAT::ProcessorAffinity *)entry;
+				if ((processor->flags & 1) && processorCount < maxProcessorCount)
+					processors[processorCount++] = ProcessorNode{processor->APICID, getNode(processor->getProximityDomain())};
+				break;
+			}
+			case SRAT::EntryGeneric::x2APICAffinity:
+			{
+				SRAT::X2APICAffinity *processor = (SRAT::X2APICAffinity *)entry;
+				if ((processor->flags & 1) && processorCount < maxProcessorCount)
+					processors[processorCount++] = ProcessorNode{processor->x2APICID, getNode(processor->proximityDomain)};
+				break;
+			}
+			case SRAT::EntryGeneric::memoryAffinity:
+			{
+				SRAT::MemoryAffinity *memory = (SRAT::MemoryAffinity *)entry;
+				qword start = (qword)memory->baseHigh << 32 | memory->baseLow,
+					  length = (qword)memory->lengthHigh << 32 | memory->lengthLow;
+				if (!(memory->flags & 1) || length == 0 || rangeCount == maxRangeCount)
+					break;
+				// kept sorted by start address
+				byte i = rangeCount++;
+				for (; i > 0 && ranges[i - 1].start > start; i--)
+					ranges[i] = ranges[i - 1];
+				ranges[i] = NodeRange{start, start + length, getNode(memory->proximityDomain)};
+				break;
+			}
+			}
+	}
+
+	byte getNodeCount() { return nodeCount; }
+	bool getMemoryNode(qword address, byte &node, qword &rangeEnd)
+	{
+		for (byte i = 0; i < rangeCount; i++)
+		{
+			if (address >= ranges[i].end)
+				continue;
+			if (address < ranges[i].start)
+			{
+				rangeEnd = ranges[i].start;
+				return false;
+			}
+			node = ranges[i].node;
+			rangeEnd = ranges[i].end;
+			return true;
+		}
+		rangeEnd = (qword)-1;
+		return false;
+	}
+	byte getProcessorNode(dword apicId)
+	{
+		for (byte i = 0; i < processorCount; i++)
+			if (processors[i].apicId == apicId)
+				return processors[i].node;
+		return 0;
+	}
+	byte getNodeDistance(byte from, byte to)
+	{
+		if (from == to)
+			return localDistance;
+		// the SLIT is indexed by proximity domain
+		if (slit == nullptr || from >= nodeCount || to >= nodeCount || nodeDomains[from] >= slit->localityCount || nodeDomains[to] >= slit->localityCount)
+			return 2 * localDistance;
+		return slit->distances[nodeDomains[from] * slit->localityCount + nodeDomains[to]];
+	}
+
+	void DisplaySRAT()
+	{
+		if (srat == nullptr)
+		{
+			cout << "SRAT not found\n";
+			return;
+		}
+		for (byte node = 0; node < nodeCount; node++)
+		{
+			cout << "Node " << node << " (proximity domain " << nodeDomains[node] << "):\n";
+			for (byte i = 0; i < rangeCount; i++)
+				if (ranges[i].node == node)
+					cout << "  Memory " << (void *)ranges[i].start << " - " << (void *)(ranges[i].end - 1) << '\n';
+			cout << "  Processors (APIC ID):";
+			for (byte i = 0; i < processorCount; i++)
+				if (processors[i].node == node)
+					cout << ' ' << processors[i].apicId;
+			cout << "\n  Distances:";
+			for (byte other = 0; other < nodeCount; other++)
+				cout << ' ' << getNodeDistance(node, other);
+			cout << '\n';
+		}
+	}
+}
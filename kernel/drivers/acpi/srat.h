@@ -0,0 +1,25 @@
+#pragma once
+#include <types.h>
+
+namespace ACPI
+{
+	static constexpr byte maxNodeCount = 8;
+	// distance of a node to itself in the SLIT
+	static constexpr byte localDistance = 10;
+
+	// read the NUMA nodes of the memory ranges and processors from the SRAT, and the distances between them from the SLIT;
+	// nothing is allocated, since the page frame allocator needs the nodes before it is built
+	void InitializeSRAT();
+
+	// 0 if there is no SRAT
+	byte getNodeCount();
+	// the node of the memory range that contains address, and the end of that range; if no range contains it,
+	// returns false and rangeEnd is where the next range starts
+	bool getMemoryNode(qword address, byte &node, qword &rangeEnd);
+	// node of the processor with the given local APIC id; 0 if the SRAT does not list it
+	byte getProcessorNode(dword apicId);
+	// relative cost of accessing the memory of node to from node from; localDistance for the same node
+	byte getNodeDistance(byte from, byte to);
+
+	void DisplaySRAT();
+}
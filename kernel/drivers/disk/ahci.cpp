@@ -394,10 +394,7 @@ namespace AHCI
 
 		VERBOSE_LOG("Paging memory mapped registers...\n");
 		PageMapLevel4 &current = PageMapLevel4::getCurrent();
-		void *pageSpace;
-		dword *pageAllocationMap;
-		Memory::GetPageSpace(pageSpace, pageAllocationMap);
-		if (!current.mapRegion(pageSpace, *pageAllocationMap, (ull)header->bar5, (ull)header->bar5, 0x2000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::pageWriteThroughBit | PageEntry::pageCacheDisable)))
+		if (!current.mapRegion((ull)header->bar5, (ull)header->bar5, 0x2000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::pageWriteThroughBit | PageEntry::pageCacheDisable)))
 		{
 			// handle error case...
 			System::blueScreen();
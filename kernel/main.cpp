@@ -13,9 +13,18 @@
 #include "cpu/gdt.h"
 #include "drivers/pci.h"
 #include "core/filesystem/filesystem.h"
+#include "core/filesystem/pagecache.h"
 #include "core/sys.h"
 #include <math.h>
 #include "core/paging.h"
+#include "core/pageframe.h"
+#include "core/pcid.h"
+#include "core/bigpages.h"
+#include "core/swap.h"
+#include "core/shrinker.h"
+#include "core/heapprofiler.h"
+#include "core/objectcache.h"
+#include "core/stackpool.h"
 #include "core/scheduler.h"
 #include "core/explorer.h"
 #include "utils/isriostream.h"
@@ -68,6 +77,8 @@ extern void main(KernelInfo &info)
 	VERBOSE_LOG("Initializing Memory...\n");
 	Memory::Initialize(info.kernelPhysicalAddress, info.memoryMapDescriptorAddress, info.memoryMapAddress);
 	// nullptr access protection starts here!!
+	VERBOSE_LOG("Detecting PCID support...\n");
+	PCID::Initialize();
 
 	VERBOSE_LOG("Initializing Screen driver...\n");
 	Screen::Initialize();
@@ -91,11 +102,15 @@ extern void main(KernelInfo &info)
 
 	VERBOSE_LOG("Enabling interrupts...\n");
 	enableInterrupts();
+	VERBOSE_LOG("Starting big page daemon...\n");
+	BigPages::Initialize();
 
 	VERBOSE_LOG("Initializing Disk driver...\n");
 	Disk::Initialize();
 	VERBOSE_LOG("Initializing Filesystem driver...\n");
 	Filesystem::Initialize();
+	VERBOSE_LOG("Starting pager...\n");
+	Filesystem::PageCache::Initialize();
 	VERBOSE_LOG("Detecting PCI devices...\n");
 	PCI::InitializeDevices();
 
@@ -342,6 +357,67 @@ void terminal()
 		{
 			Memory::DisplayMap();
 		}
+		else if (subCmd == "frames")
+		{
+			PageFrame::DisplaySummary();
+		}
+		else if (subCmd == "bigpages")
+		{
+			BigPages::DisplaySummary();
+		}
+		else if (subCmd == "pagecache")
+		{
+			Filesystem::PageCache::DisplaySummary();
+		}
+		else if (subCmd == "swap")
+		{
+			if (cmd.length() == 0)
+				Swap::DisplaySummary();
+			else if (getSubcommand(cmd, subCmd) && subCmd == "create")
+			{
+				// an optional size in MB
+				ull size = 0;
+				for (char c : cmd)
+					if (c >= '0' && c <= '9')
+						size = size * 10 + c - '0';
+				size = size ? size * 0x100000 : Swap::defaultSize;
+				if (Swap::Create(size))
+					cout << "Swapping to a file of " << size / 0x100000 << "MB\n";
+			}
+			else
+				cout << "Invalid command.\n";
+		}
+		else if (subCmd == "shrinkers")
+		{
+			Shrinker::DisplaySummary();
+		}
+		else if (subCmd == "objcaches")
+		{
+			ObjectCache::DisplaySummary();
+		}
+		else if (subCmd == "stacks")
+		{
+			StackPool::DisplaySummary();
+		}
+		else if (subCmd == "memspeed")
+		{
+			Memory::BenchmarkCopy();
+		}
+		else if (subCmd == "heap")
+		{
+			if (cmd == "slabs")
+				Memory::Heap::displaySlabSummaryFromSelected();
+			else if (getSubcommand(cmd, subCmd) && subCmd == "sites")
+			{
+				// an optional path of the linker map
+				string16 path;
+				for (char c : cmd)
+					path += c;
+				HeapProfiler::DisplaySites(path);
+			}
+			else
+				cout << "Invalid command.\n";
+		}
 		else if (subCmd == "cpu")
 		{
 			if (cmd == "speed")
@@ -458,6 +534,10 @@ void terminal()
 				{
 					ACPI::DisplayMADT();
 				}
+				else if (subCmd == "srat")
+				{
+					ACPI::DisplaySRAT();
+				}
 				else if (subCmd == "namespace")
 				{
 					string indentation = "";
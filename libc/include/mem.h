@@ -8,121 +8,539 @@ namespace Memory
 	extern Heap *selectedHeap;
 	class Heap
 	{
+		// every block of the heap area, free or allocated, is delimited by a header and a trailer (boundary tags)
+		// holding its size, so that both neighbours of a block can be found in O(1)
 		class AllocatorEntry
 		{
-		public:
-			AllocatorEntry *prevAllocation, *nextAllocation;
-
-		private:
-			qword allocatedSize;
+			// total size of the block, including header and trailer; bit 0 is set if the block is allocated
+			qword blockSize;
 
 			static constexpr int magicNumberStart = 0x514a2b04;
 			static constexpr int magicNumberEnd = 0xa94b5fcb;
+			static constexpr qword allocatedBit = 1;
+
+		public:
+			// low half of the address that requested the block, see Heap::packSite; 0 for blocks of the heap itself
 			int reserved;
+
+		private:
 			int magicCheckStart;
 
-			inline int &magicCheckEnd() { return *(int *)((byte *)(this + 1) + allocatedSize); }
+			class Trailer
+			{
+			public:
+				qword blockSize;
+				int reserved;
+				int magicCheckEnd;
+			};
+			inline Trailer *trailer() { return (Trailer *)((byte *)this + getBlockSize()) - 1; }
 
 		public:
-			static constexpr qword headerSize = sizeof(AllocatorEntry *) * 2 + sizeof(qword) + sizeof(int) * 2,
-								   trailerSize = sizeof(int),
-								   maintenanceSize = headerSize + trailerSize;
+			// links in the free list, only valid while the block is free
+			AllocatorEntry *prevFree, *nextFree;
 
-			inline static AllocatorEntry *build(void *address, qword allocationSize, AllocatorEntry *prevAllocation_, AllocatorEntry *nextAllocation_)
+			static constexpr qword headerSize = sizeof(qword) + sizeof(int) * 2,
+								   trailerSize = sizeof(Trailer),
+								   maintenanceSize = headerSize + trailerSize,
+								   minBlockSize = maintenanceSize + sizeof(AllocatorEntry *) * 2;
+
+			inline static AllocatorEntry *build(void *address, qword blockSize, bool allocated)
 			{
 				AllocatorEntry *obj = (AllocatorEntry *)address;
-				obj->prevAllocation = prevAllocation_;
-				obj->nextAllocation = nextAllocation_;
-				obj->allocatedSize = allocationSize;
+				obj->blockSize = blockSize | (allocated ? allocatedBit : 0);
+				obj->reserved = 0;
 				obj->magicCheckStart = magicNumberStart;
-				obj->magicCheckEnd() = magicNumberEnd;
+				Trailer *trailer = obj->trailer();
+				trailer->blockSize = obj->blockSize;
+				trailer->reserved = 0;
+				trailer->magicCheckEnd = magicNumberEnd;
 				return obj;
 			}
+			// the closing tag of the heap area; has no trailer and never gets merged
+			inline static AllocatorEntry *buildEnd(void *address)
+			{
+				AllocatorEntry *obj = (AllocatorEntry *)address;
+				obj->blockSize = allocatedBit;
+				obj->magicCheckStart = magicNumberStart;
+				return obj;
+			}
+
+			inline qword getBlockSize() { return blockSize & ~allocatedBit; }
+			inline qword getAllocatedSize() { return getBlockSize() - maintenanceSize; }
+			inline bool isAllocated() { return blockSize & allocatedBit; }
+			inline bool isEnd() { return blockSize == allocatedBit; }
 
-			inline void *getSpaceAfter() { return (byte *)this + maintenanceSize + allocatedSize; }
-			inline void *getAllocatedBlock() { return this + 1; }
+			inline AllocatorEntry *getNext() { return (AllocatorEntry *)((byte *)this + getBlockSize()); }
+			// the previous block is found through its trailer, which sits right before this header
+			inline bool isPrevAllocated() { return ((Trailer *)this - 1)->blockSize & allocatedBit; }
+			inline AllocatorEntry *getPrev() { return (AllocatorEntry *)((byte *)this - (((Trailer *)this - 1)->blockSize & ~allocatedBit)); }
+
+			inline void *getAllocatedBlock() { return (byte *)this + headerSize; }
+			inline static AllocatorEntry *fromAllocatedBlock(void *ptr) { return (AllocatorEntry *)((byte *)ptr - headerSize); }
 
 			void CorruptionDetected();
-			inline bool Corrupted() { return magicCheckStart != magicNumberStart || magicCheckEnd() != magicNumberEnd; }
-			bool free()
+			inline bool Corrupted() { return magicCheckStart != magicNumberStart || trailer()->magicCheckEnd != magicNumberEnd || trailer()->blockSize != blockSize; }
+		};
+
+	public:
+		// small allocations are served from segregated size classes (16, 32, 64 ... 4096 bytes)
+		static constexpr byte slabClassCount = 9,
+							  slabMinClassShift = 4;
+		static constexpr qword slabPageSize = 0x1000;
+
+		class SlabStatistics
+		{
+		public:
+			ull hits, misses, liveObjects, slabCount;
+		};
+		// allocations made by one caller, identified by the return address of malloc or new
+		class SiteStatistics
+		{
+		public:
+			qword site;
+			ull allocations, liveObjects, liveBytes;
+		};
+		static constexpr word siteTableSize = 256;
+
+	private:
+		class Slab
+		{
+		public:
+			Slab *prevSlab, *nextSlab;
+			void *freeList;
+			word usedCount, capacity;
+			// packed site of each object, indexed by its offset in the slab divided by the object size;
+			// only there if the heap is profiled
+			int sites[0];
+
+			inline bool isFull() { return freeList == nullptr; }
+			inline bool isEmpty() { return usedCount == 0; }
+		};
+		class SlabCache
+		{
+		public:
+			// slabs that have at least one free object
+			Slab *partialSlabs;
+			// a completely free slab kept around to avoid thrashing the heap
+			Slab *emptySlab;
+			SlabStatistics statistics;
+
+			inline static qword objectSize(byte sizeClass) { return (qword)1 << (sizeClass + slabMinClassShift); }
+			inline static qword slabSize(byte sizeClass)
 			{
-				if (Corrupted())
-				{
-					CorruptionDetected();
-					return false;
-				}
-
-				magicCheckStart = 0;
-				magicCheckEnd() = 0;
-				if (this->prevAllocation)
-					prevAllocation->nextAllocation = this->nextAllocation;
-				if (this->nextAllocation)
-					nextAllocation->prevAllocation = this->prevAllocation;
-				return true;
+				// at least 7 objects per slab for the bigger classes
+				qword size = objectSize(sizeClass) * 8;
+				return size < slabPageSize ? slabPageSize : size;
 			}
+			inline static qword firstObjectOffset(byte sizeClass, bool profiled)
+			{
+				qword header = sizeof(Slab) + (profiled ? slabSize(sizeClass) / objectSize(sizeClass) * sizeof(int) : 0);
+				return alignValueUpwards(header, objectSize(sizeClass));
+			}
+
+			inline void linkPartial(Slab *slab)
+			{
+				slab->prevSlab = nullptr;
+				slab->nextSlab = partialSlabs;
+				if (partialSlabs)
+					partialSlabs->prevSlab = slab;
+				partialSlabs = slab;
+			}
+			inline void unlinkPartial(Slab *slab)
+			{
+				if (slab->prevSlab)
+					slab->prevSlab->nextSlab = slab->nextSlab;
+				else
+					partialSlabs = slab->nextSlab;
+				if (slab->nextSlab)
+					slab->nextSlab->prevSlab = slab->prevSlab;
+			}
+		};
+
+		class Arena;
+		// arenas are found through the granules of address space they cover: an arena is linked into the bucket of
+		// every granule it touches, so a lookup only looks at the few arenas that share the bucket of the address
+		static constexpr byte arenaGranuleShift = 21;
+		static constexpr word arenaBucketCount = 128;
+		class ArenaLink
+		{
+		public:
+			Arena *arena;
+			ArenaLink *next;
+		};
+		// a continuous block of memory given to the heap; merges never cross the bounds of an arena
+		class Arena
+		{
+		public:
+			Arena *next;
+			// the whole block, including this header
+			qword length;
+
+			byte *areaStart;
+			qword areaSize;
+
+			// one byte per page of the area: 0 for general allocations, sizeClass + 1 for pages owned by a slab
+			byte *slabPageMap;
+			qword slabPageMapLength;
+
+			// one link per granule of the block, in the header after the slab page map
+			ArenaLink *links;
+			qword linkCount;
+
+			inline bool contains(void *ptr) { return ptr >= areaStart && ptr < areaStart + areaSize; }
+			// the allocated empty block at the start of the area
+			inline AllocatorEntry *first() { return (AllocatorEntry *)areaStart; }
+			// true if the area is a single free block
+			inline bool isEmpty() { return !first()->getNext()->isAllocated() && first()->getNext()->getNext()->isEnd(); }
+
+			inline static qword getLinkCount(void *address, qword length) { return (((qword)address + length - 1) >> arenaGranuleShift) - ((qword)address >> arenaGranuleShift) + 1; }
 		};
 
+		Arena *arenas;
+		ArenaLink *arenaBuckets[arenaBucketCount];
+		// an arena that became empty is kept for the next growth, instead of going back to releaseMemory right away
+		Arena *emptyArena;
 		qword heapSize;
-		AllocatorEntry *firstAllocation, *lastAllocation;
+		ull blockCount;
+		inline ArenaLink *&getArenaBucket(qword address) { return arenaBuckets[(address >> arenaGranuleShift) % arenaBucketCount]; }
 
-		// allocationSize is assumed to be a multiple of alignment
-		inline bool fitsAllocation(void *&start, void *end, qword allocationSize, ull alignment)
+		// where more memory comes from when the heap is full, and where empty arenas go back to
+		void *(*requestMemory)(qword &size);
+		void (*releaseMemory)(void *address, qword size);
+		// frees memory held by caches of the owner of the heap; returns false if nothing could be freed
+		bool (*reclaimMemory)(qword size);
+
+		// big allocations get pages of their own, so that they never split the free blocks of the arenas;
+		// they are found again through a hash of their address
+		class LargeObject
 		{
-			ull alignedStart = alignValueUpwards((ull)start + AllocatorEntry::headerSize, alignment) - AllocatorEntry::headerSize;
-			// from "if ((ull)end - alignedStart >= allocationSize + AllocatorEntry::maintenanceSize)",
-			//		rearrange so that there are no subtractions, since there are only unsigned numbers
-			if ((ull)end >= allocationSize + AllocatorEntry::maintenanceSize + alignedStart)
+		public:
+			LargeObject *next;
+			void *address;
+			qword length;
+			int site;
+		};
+		static constexpr word largeObjectBucketCount = 64;
+		LargeObject *largeObjects[largeObjectBucketCount];
+		ull largeObjectCount;
+		inline LargeObject *&getLargeObjectBucket(void *address) { return largeObjects[((qword)address >> 12) % largeObjectBucketCount]; }
+		// the records come from pages of their own, so that they are not counted as allocations of the heap;
+		// those pages are kept for the next large objects
+		LargeObject *freeLargeObjects;
+		void *(*requestPages)(qword size);
+		void (*releasePages)(void *address, qword size);
+
+		// free blocks are kept in segregated lists, one for each power of two of their size;
+		// bit i of freeListMap is set if freeLists[i] is not empty
+		static constexpr byte freeListCount = 64;
+		AllocatorEntry *freeLists[freeListCount];
+		ull freeListMap;
+
+		SlabCache slabCaches[slabClassCount];
+
+	public:
+		// small objects freed and allocated again on the same cpu go through magazines: bounded stacks of free
+		// objects, two per cpu and size class; full and empty magazines are exchanged with a depot shared by all cpus
+		static constexpr byte maxCPUCount = 8,
+							  magazineSize = 14;
+
+		class MagazineStatistics
+		{
+		public:
+			ull hits, misses;
+		};
+
+	private:
+		class Magazine
+		{
+		public:
+			Magazine *next;
+			qword count;
+			void *rounds[magazineSize];
+
+			inline bool isFull() { return count == magazineSize; }
+			inline bool isEmpty() { return count == 0; }
+		};
+		class CPUMagazines
+		{
+		public:
+			Magazine *loaded, *previous;
+		};
+		class Depot
+		{
+		public:
+			Magazine *full, *empty;
+		};
+		CPUMagazines cpuMagazines[maxCPUCount][slabClassCount];
+		Depot depots[slabClassCount];
+		MagazineStatistics magazineStatistics[slabClassCount];
+		// objects waiting in magazines, and the magazines themselves, are allocated as far as the slabs know
+		ull magazineRounds, magazineCount;
+		// give the index of the current cpu, and keep the caller on it until leaveCPU; nullptr disables the magazines
+		qword (*enterCPU)(byte &cpu);
+		void (*leaveCPU)(qword state);
+		// keep everyone else out of the heap until unlock, for owners that allocate from interrupt handlers too;
+		// lock returns the state that unlock restores, and has to allow nesting
+		qword (*lock)();
+		void (*unlock)(qword state);
+
+		inline static void push(Magazine *&list, Magazine *magazine)
+		{
+			magazine->next = list;
+			list = magazine;
+		}
+		inline static Magazine *pop(Magazine *&list)
+		{
+			Magazine *magazine = list;
+			if (magazine)
+				list = magazine->next;
+			return magazine;
+		}
+		void *AllocateFromMagazine(byte sizeClass, qword site);
+		// returns false if the object has to go back to its slab
+		bool DeallocateToMagazine(void *ptr, byte sizeClass);
+		void setObjectSite(void *ptr, byte sizeClass, qword site);
+		ull heldRounds(byte sizeClass);
+
+		// open addressing by site; a site that is not found within a few entries of its slot is not tracked
+		static constexpr byte maxSiteProbes = 8;
+		SiteStatistics sites[siteTableSize];
+		ull untrackedAllocations;
+		// sites are only recorded if this is set, which has to be decided before the first slab is made
+		bool profiled;
+
+		// every caller is in the lower or the upper 2GB of the address space, so the low half of its
+		// address is enough to tell them apart: the upper half is its sign extension
+		inline static int packSite(qword site) { return (int)site; }
+		inline static qword unpackSite(int site) { return (qword)(sqword)site; }
+		SiteStatistics *findSite(qword site, bool add);
+		void recordAllocation(qword site, qword size);
+		void recordDeallocation(int site, qword size);
+
+		inline static byte getFreeListIndex(qword blockSize) { return 63 - __builtin_clzll(blockSize); }
+		inline void insertFree(AllocatorEntry *entry)
+		{
+			byte index = getFreeListIndex(entry->getBlockSize());
+			entry->prevFree = nullptr;
+			entry->nextFree = freeLists[index];
+			if (freeLists[index])
+				freeLists[index]->prevFree = entry;
+			freeLists[index] = entry;
+			freeListMap |= (ull)1 << index;
+		}
+		inline void removeFree(AllocatorEntry *entry)
+		{
+			byte index = getFreeListIndex(entry->getBlockSize());
+			if (entry->prevFree)
+				entry->prevFree->nextFree = entry->nextFree;
+			else
+				freeLists[index] = entry->nextFree;
+			if (entry->nextFree)
+				entry->nextFree->prevFree = entry->prevFree;
+			if (!freeLists[index])
+				freeListMap &= ~((ull)1 << index);
+		}
+		AllocatorEntry *findFree(qword blockSize);
+
+		// returns false if the allocation must be served by the general heap
+		inline static bool getSlabClass(qword allocationSize, ull alignment, byte &sizeClass)
+		{
+			qword size = allocationSize > alignment ? allocationSize : alignment;
+			if (size > SlabCache::objectSize(slabClassCount - 1))
+				return false;
+			sizeClass = 0;
+			while (SlabCache::objectSize(sizeClass) < size)
+				sizeClass++;
+			return true;
+		}
+		inline Arena *getArena(void *ptr)
+		{
+			for (ArenaLink *link = getArenaBucket((qword)ptr); link; link = link->next)
+				if (link->arena->contains(ptr))
+					return link->arena;
+			return nullptr;
+		}
+		// returns 0 if the address is not owned by a slab, sizeClass + 1 otherwise
+		inline static byte getSlabPageEntry(Arena *arena, void *ptr) { return arena->slabPageMap[((qword)ptr >> 12) - ((qword)arena->areaStart >> 12)]; }
+		inline byte getSlabPageEntry(void *ptr)
+		{
+			Arena *arena = getArena(ptr);
+			return arena ? getSlabPageEntry(arena, ptr) : 0;
+		}
+		void markSlabPages(Slab *slab, qword size, byte entry);
+
+		void *AllocateFromSlab(byte sizeClass, qword site);
+		void DeallocateFromSlab(void *ptr, byte sizeClass);
+
+		void *AllocateBlock(qword allocationSize, ull alignment);
+		void DeallocateBlock(void *ptr);
+
+		void *AllocateLarge(qword allocationSize, qword site);
+		void DeallocateLarge(void *ptr);
+
+		void *AllocateUnlocked(qword allocationSize, ull alignment, qword site);
+		void DeallocateUnlocked(void *ptr)
+		{
+			if (!ptr)
+				return;
+			Arena *arena = getArena(ptr);
+			if (!arena)
+			{
+				DeallocateLarge(ptr);
+				return;
+			}
+			byte entry = getSlabPageEntry(arena, ptr);
+			if (entry)
 			{
-				start = (void *)alignedStart;
-				return true;
+				if (!enterCPU || !DeallocateToMagazine(ptr, entry - 1))
+					DeallocateFromSlab(ptr, entry - 1);
 			}
-			return false;
+			else
+				DeallocateBlock(ptr);
 		}
 
-		void CorruptionDetected(void *corruptedAllocation);
-
-		inline void *heapStart() { return (void *)(this + 1); }
+		// get a new arena big enough for the allocation from requestMemory
+		bool grow(qword allocationSize, ull alignment);
+		void releaseArena(Arena *arena);
 
 	public:
-		inline static Heap *build(void *address, qword size)
+		// allocations of at least this size go to the large object pages, if the heap has a source for them
+		static constexpr qword largeObjectThreshold = 0x8000;
+
+		// profiled heaps record the caller of every allocation, see SiteStatistics
+		inline static Heap *build(void *address, qword size, bool profiled = false)
 		{
 			Heap *obj = (Heap *)address;
-			obj->heapSize = size - sizeof(Heap);
-			obj->firstAllocation = nullptr;
-			obj->lastAllocation = nullptr;
+			obj->arenas = nullptr;
+			for (ArenaLink *&bucket : obj->arenaBuckets)
+				bucket = nullptr;
+			obj->emptyArena = nullptr;
+			obj->heapSize = 0;
+			obj->blockCount = 0;
+			obj->requestMemory = nullptr;
+			obj->releaseMemory = nullptr;
+			obj->reclaimMemory = nullptr;
+			for (LargeObject *&bucket : obj->largeObjects)
+				bucket = nullptr;
+			obj->largeObjectCount = 0;
+			obj->freeLargeObjects = nullptr;
+			obj->requestPages = nullptr;
+			obj->releasePages = nullptr;
+			obj->freeListMap = 0;
+			for (AllocatorEntry *&list : obj->freeLists)
+				list = nullptr;
+			for (SlabCache &cache : obj->slabCaches)
+			{
+				cache.partialSlabs = nullptr;
+				cache.emptySlab = nullptr;
+				cache.statistics = SlabStatistics{0, 0, 0, 0};
+			}
+			for (auto &cpu : obj->cpuMagazines)
+				for (CPUMagazines &magazines : cpu)
+					magazines = CPUMagazines{nullptr, nullptr};
+			for (byte c = 0; c < slabClassCount; c++)
+			{
+				obj->depots[c] = Depot{nullptr, nullptr};
+				obj->magazineStatistics[c] = MagazineStatistics{0, 0};
+			}
+			obj->magazineRounds = obj->magazineCount = 0;
+			obj->enterCPU = nullptr;
+			obj->leaveCPU = nullptr;
+			obj->lock = nullptr;
+			obj->unlock = nullptr;
+			for (SiteStatistics &site : obj->sites)
+				site = SiteStatistics{0, 0, 0, 0};
+			obj->untrackedAllocations = 0;
+			obj->profiled = profiled;
+
+			obj->addArena(obj + 1, (byte *)address + size - (byte *)(obj + 1));
 			return obj;
 		}
+		// give another block of memory to the heap
+		bool addArena(void *address, qword size);
+		// let the heap grow on demand; release can be nullptr if arenas are never given back
+		inline void setMemorySource(void *(*request)(qword &size), void (*release)(void *address, qword size))
+		{
+			requestMemory = request;
+			releaseMemory = release;
+		}
+		// called once before an allocation fails, when requestMemory has nothing left to give
+		inline void setReclaimer(bool (*reclaim)(qword size)) { reclaimMemory = reclaim; }
+		inline void setLock(qword (*lockHeap)(), void (*unlockHeap)(qword state))
+		{
+			lock = lockHeap;
+			unlock = unlockHeap;
+		}
+		// turn the magazines on; enter returns the state that leave restores
+		inline void setCPUSource(qword (*enter)(byte &cpu), void (*leave)(qword state))
+		{
+			enterCPU = enter;
+			leaveCPU = leave;
+		}
+		// the empty arena kept for the next growth, which can be given back when memory is short
+		qword getEmptyArenaBytes();
+		// returns the number of bytes given back
+		qword releaseEmptyArena();
+		// the objects in the magazines of the depot, which any cpu can give back to the slabs
+		qword getDepotBytes();
+		// returns the number of bytes given back
+		qword drainDepot(qword bytes);
+		inline const MagazineStatistics &getMagazineStatistics(byte sizeClass) { return magazineStatistics[sizeClass]; }
+		// where large objects get their pages from; the length is a multiple of the page size
+		inline void setLargeObjectSource(void *(*request)(qword length), void (*release)(void *address, qword length))
+		{
+			requestPages = request;
+			releasePages = release;
+		}
 
 		inline qword getSize() { return heapSize; }
 		inline ull getAllocationCount()
 		{
-			ull c = 0;
-			for (AllocatorEntry *i = firstAllocation; i; i = i->nextAllocation)
-				c++;
-			return c;
+			// slabs are bookkeeping, count the objects inside them instead
+			ull c = blockCount + largeObjectCount;
+			for (SlabCache &cache : slabCaches)
+				c += cache.statistics.liveObjects - cache.statistics.slabCount;
+			return c - magazineRounds - magazineCount;
 		}
 		void displayAllocationSummary();
+		inline const SlabStatistics &getSlabStatistics(byte sizeClass) { return slabCaches[sizeClass].statistics; }
+		inline static qword getSlabObjectSize(byte sizeClass) { return SlabCache::objectSize(sizeClass); }
+		void displaySlabSummary();
+		inline bool isProfiled() { return profiled; }
+		// entries with site 0 are unused
+		inline const SiteStatistics &getSiteStatistics(word index) { return sites[index]; }
+		inline ull getUntrackedAllocations() { return untrackedAllocations; }
 
-		void *Allocate(qword allocationSize, ull alignment);
-		void Deallocate(void *ptr)
+		// site is the address the allocation is reported under, 0 if it is not known
+		inline void *Allocate(qword allocationSize, ull alignment, qword site = 0)
+		{
+			if (!lock)
+				return AllocateUnlocked(allocationSize, alignment, site);
+			qword state = lock();
+			void *obj = AllocateUnlocked(allocationSize, alignment, site);
+			unlock(state);
+			return obj;
+		}
+		inline void Deallocate(void *ptr)
 		{
-			AllocatorEntry *obj = (AllocatorEntry *)ptr - 1;
-			obj->free();
-			if (obj == firstAllocation)
-				firstAllocation = obj->nextAllocation;
-			if (obj == lastAllocation)
-				lastAllocation = obj->prevAllocation;
+			if (!lock)
+				return DeallocateUnlocked(ptr);
+			qword state = lock();
+			DeallocateUnlocked(ptr);
+			unlock(state);
 		}
 
-		inline static void *AllocateFromSelected(qword allocationSize, ull alignment) { return selectedHeap ? selectedHeap->Allocate(allocationSize, alignment) : nullptr; }
+		inline static void *AllocateFromSelected(qword allocationSize, ull alignment, qword site = 0) { return selectedHeap ? selectedHeap->Allocate(allocationSize, alignment, site) : nullptr; }
 		inline static void DeallocateFromSelected(void *ptr) { selectedHeap->Deallocate(ptr); }
 		inline static void DeallocateFromSelected(void *ptr, ull size) { selectedHeap->Deallocate(ptr); }
 
 		inline static ull getAllocationCountFromSelected() { return selectedHeap->getAllocationCount(); }
 		inline static void displayAllocationSummaryFromSelected() { return selectedHeap->displayAllocationSummary(); }
+		inline static void displaySlabSummaryFromSelected() { return selectedHeap->displaySlabSummary(); }
 	};
 
-	inline void *Allocate(ull size, ull alignment) { return Heap::AllocateFromSelected(size, alignment); }
+	// not inline, so that the allocation is reported under its caller
+	void *Allocate(ull size, ull alignment);
 };
 
 void *malloc(ull size);
@@ -29,15 +29,17 @@
 
 #define SYSCALL_FILESYSTEM_READFILE 0
 #define SYSCALL_FILESYSTEM_WRITEFILE 1
+#define SYSCALL_FILESYSTEM_MAPFILE 2
 // #define SYSCALL_FILESYSTEM_GET
 
 #define SYSCALL_PROGENV_EXIT 0
 #define SYSCALL_PROGENV_WAITFORTASK 1
 #define SYSCALL_PROGENV_WAITFORTHREAD 2
 #define SYSCALL_PROGENV_CREATETHREAD 3
-// #define SYSCALL_PROGENV_ALLOCHEAP 3
-// #define SYSCALL_PROGENV_HEAPFULL 4
-// #define SYSCALL_PROGENV_HEAPCORRUPTION 5
+#define SYSCALL_PROGENV_RESERVEMEMORY 4
+#define SYSCALL_PROGENV_RELEASEMEMORY 5
+// #define SYSCALL_PROGENV_HEAPFULL 6
+// #define SYSCALL_PROGENV_HEAPCORRUPTION 7
 
 #define SYSCALL_CURSOR_ENABLE 0
 #define SYSCALL_CURSOR_DISABLE 1
@@ -215,6 +217,46 @@ namespace Scheduler
 	}
 }
 
+namespace Memory
+{
+	// reserve a range of virtual memory; pages are allocated when first accessed
+	// returns nullptr if the range could not be reserved
+	inline void *reserveVirtual(ull len)
+	{
+		void *address;
+		asm volatile(
+			"int 0x30"
+			: "=a"(address)
+			: "a"(SYSCALL_PROGENV), "b"(SYSCALL_PROGENV_RESERVEMEMORY), "D"(len));
+		return address;
+	}
+	inline bool releaseVirtual(void *address, ull len)
+	{
+		bool result;
+		asm volatile(
+			"int 0x30"
+			: "=a"(result)
+			: "a"(SYSCALL_PROGENV), "b"(SYSCALL_PROGENV_RELEASEMEMORY), "D"(address), "S"(len));
+		return result;
+	}
+}
+
+namespace Filesystem
+{
+	// map a part of a file; pages are read when they are first accessed, and written back some time after they change
+	// offset has to be page aligned, length 0 maps the rest of the file; returns nullptr on failure
+	// the mapping is removed with Memory::releaseVirtual
+	inline void *mapFile(const char16_t *path, ull pathLength, ull offset, ull length)
+	{
+		void *address;
+		asm volatile(
+			"int 0x30"
+			: "=a"(address)
+			: "a"(SYSCALL_FILESYSTEM), "b"(SYSCALL_FILESYSTEM_MAPFILE), "D"(path), "S"(pathLength), "d"(offset), "c"(length));
+		return address;
+	}
+}
+
 namespace Disk
 {
 	inline uint read(void *diskPtr, uint startLba, uint sectorCount, byte *buffer)
@@ -3,10 +3,34 @@
 
 extern int main();
 
+// the heap grows in reserved ranges of at least heapGrowSize; their pages are only allocated when used
+static constexpr qword initialHeapSize = 0x10000,
+					   heapGrowSize = 0x1000000;
+
+void *requestHeapMemory(qword &size)
+{
+	size = alignValueUpwards(size < heapGrowSize ? heapGrowSize : size, 0x1000);
+	return Memory::reserveVirtual(size);
+}
+void releaseHeapMemory(void *address, qword size)
+{
+	Memory::releaseVirtual(address, size);
+}
+// large objects get a range of their own, whose pages are committed as they are touched
+void *requestLargeObjectMemory(qword length)
+{
+	return Memory::reserveVirtual(length);
+}
+
 extern "C" void entry()
 {
 	// initialize heap
-	Memory::selectedHeap = Memory::Heap::build((void *)0x7f0000000000, 0x10000);
+	void *heap = Memory::reserveVirtual(initialHeapSize);
+	if (!heap)
+		exit(-1);
+	Memory::selectedHeap = Memory::Heap::build(heap, initialHeapSize);
+	Memory::selectedHeap->setMemorySource(requestHeapMemory, releaseHeapMemory);
+	Memory::selectedHeap->setLargeObjectSource(requestLargeObjectMemory, releaseHeapMemory);
 
 	// call main
 	exit(main());
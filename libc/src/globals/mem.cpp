@@ -13,8 +13,12 @@ namespace Memory
 		cout << ostream::base::hex;
 		if (magicCheckStart != magicNumberStart)
 			cout << "Found start signature " << magicCheckStart << " instead of " << magicNumberStart << '\n';
-		if (magicCheckEnd() != magicNumberEnd)
-			cout << "Found end signature " << magicCheckEnd() << " instead of " << magicNumberEnd << '\n';
+		else if (!isAllocated())
+			cout << "Block is not allocated\n";
+		else if (trailer()->magicCheckEnd != magicNumberEnd)
+			cout << "Found end signature " << trailer()->magicCheckEnd << " instead of " << magicNumberEnd << '\n';
+		else if (trailer()->blockSize != blockSize)
+			cout << "Found trailer size " << trailer()->blockSize << " instead of " << blockSize << '\n';
 		cout << ostream::base::dec;
 		cout << "Memory dump:\n";
 		DisplayMemoryBlock((byte *)this, 0x100);
@@ -22,82 +26,640 @@ namespace Memory
 
 	void Heap::displayAllocationSummary()
 	{
-		for (auto *i = firstAllocation; i; i = i->nextAllocation)
+		for (Arena *arena = arenas; arena; arena = arena->next)
+			for (AllocatorEntry *i = arena->first()->getNext(); !i->isEnd(); i = i->getNext())
+			{
+				// slabs are reported per size class below
+				if (!i->isAllocated() || getSlabPageEntry(i->getAllocatedBlock()))
+					continue;
+				cout << "Allocation of " << i->getAllocatedSize() << " bytes at " << (void *)i << ", data at " << (void *)i->getAllocatedBlock();
+				if (i->reserved)
+					cout << ", from " << (void *)unpackSite(i->reserved);
+				cout << ":\n";
+				DisplayMemoryBlock((byte *)i->getAllocatedBlock(), 0x30);
+			}
+		for (LargeObject *bucket : largeObjects)
+			for (LargeObject *object = bucket; object; object = object->next)
+			{
+				cout << "Large allocation of " << object->length << " bytes at " << object->address;
+				if (object->site)
+					cout << ", from " << (void *)unpackSite(object->site);
+				cout << '\n';
+			}
+		byte magazineClass;
+		getSlabClass(sizeof(Magazine), 0x10, magazineClass);
+		for (byte c = 0; c < slabClassCount; c++)
+		{
+			// objects in magazines are free, and the magazines are the heap's own
+			ull live = slabCaches[c].statistics.liveObjects - heldRounds(c);
+			if (c == magazineClass)
+				live -= magazineCount;
+			if (live)
+				cout << live << " allocations of up to " << SlabCache::objectSize(c) << " bytes in slabs\n";
+		}
+	}
+	void Heap::displaySlabSummary()
+	{
+		cout << "Size  | Hits       | Misses     | Live       | Slabs | Magazine hits | Misses     | Held\n";
+		for (byte c = 0; c < slabClassCount; c++)
 		{
-			// cheat to get the allocation size
-			ull size = ((ull *)i)[2];
-			cout << "Allocation of " << size << " bytes at " << (void *)i << ", data at " << (void *)i->getAllocatedBlock() << ":\n";
-			DisplayMemoryBlock((byte *)i->getAllocatedBlock(), 0x30);
+			SlabStatistics &stats = slabCaches[c].statistics;
+			cout << SlabCache::objectSize(c) << "\t| " << stats.hits << "\t| " << stats.misses << "\t| " << stats.liveObjects << "\t| " << stats.slabCount;
+			cout << "\t| " << magazineStatistics[c].hits << "\t| " << magazineStatistics[c].misses << "\t| " << heldRounds(c) << '\n';
 		}
+		if (enterCPU)
+			cout << magazineCount << " magazines of " << magazineSize << " objects\n";
 	}
-	void *Heap::Allocate(qword allocationSize, ull alignment)
+	ull Heap::heldRounds(byte sizeClass)
 	{
-		allocationSize = alignValueUpwards(allocationSize, alignment);
-		void *alignedStart;
+		ull count = 0;
+		for (auto &cpu : cpuMagazines)
+		{
+			if (cpu[sizeClass].loaded)
+				count += cpu[sizeClass].loaded->count;
+			if (cpu[sizeClass].previous)
+				count += cpu[sizeClass].previous->count;
+		}
+		for (Magazine *magazine = depots[sizeClass].full; magazine; magazine = magazine->next)
+			count += magazine->count;
+		return count;
+	}
 
-		// if there is no allocation, try to begin filling the heap
-		if (!firstAllocation)
+	Heap::SiteStatistics *Heap::findSite(qword site, bool add)
+	{
+		word index = (site >> 4) % siteTableSize;
+		for (byte i = 0; i < maxSiteProbes; i++, index = (index + 1) % siteTableSize)
 		{
-			alignedStart = heapStart();
-			if (!fitsAllocation(alignedStart, (byte *)alignedStart + heapSize, allocationSize, alignment))
-				return nullptr;
-			AllocatorEntry *obj = AllocatorEntry::build(alignedStart, allocationSize, nullptr, nullptr);
-			firstAllocation = obj;
-			lastAllocation = obj;
-			return obj->getAllocatedBlock();
+			if (sites[index].site == site)
+				return &sites[index];
+			if (sites[index].site == 0)
+			{
+				if (!add)
+					return nullptr;
+				sites[index].site = site;
+				return &sites[index];
+			}
+		}
+		return nullptr;
+	}
+	void Heap::recordAllocation(qword site, qword size)
+	{
+		if (!profiled)
+			return;
+		SiteStatistics *stats = findSite(site, true);
+		if (!stats)
+		{
+			untrackedAllocations++;
+			return;
+		}
+		stats->allocations++;
+		stats->liveObjects++;
+		stats->liveBytes += size;
+	}
+	void Heap::recordDeallocation(int site, qword size)
+	{
+		// sites are never removed from the table, so one that is not there was never tracked
+		SiteStatistics *stats = site && profiled ? findSite(unpackSite(site), false) : nullptr;
+		if (!stats)
+			return;
+		stats->liveObjects--;
+		stats->liveBytes -= size;
+	}
+
+	bool Heap::addArena(void *address, qword size)
+	{
+		Arena *arena = (Arena *)address;
+		arena->length = size;
+
+		// the slab page map covers the whole block, which is slightly more than the area
+		arena->slabPageMap = (byte *)(arena + 1);
+		arena->slabPageMapLength = integerCeilDivide(size, slabPageSize) + 1;
+		arena->links = (ArenaLink *)alignValueUpwards((ull)(arena->slabPageMap + arena->slabPageMapLength), 0x10);
+		arena->linkCount = Arena::getLinkCount(address, size);
+		arena->areaStart = (byte *)alignValueUpwards((ull)(arena->links + arena->linkCount), 0x10);
+		if ((byte *)address + size < arena->areaStart + AllocatorEntry::maintenanceSize + AllocatorEntry::minBlockSize + AllocatorEntry::headerSize)
+			return false;
+		arena->areaSize = ((byte *)address + size - arena->areaStart) & ~(qword)0xf;
+		for (qword i = 0; i < arena->slabPageMapLength; i++)
+			arena->slabPageMap[i] = 0;
+
+		// an allocated empty block at the start and the end tag keep merges inside the area
+		AllocatorEntry *first = AllocatorEntry::build(arena->areaStart, AllocatorEntry::maintenanceSize, true);
+		AllocatorEntry *end = AllocatorEntry::buildEnd(arena->areaStart + arena->areaSize - AllocatorEntry::headerSize);
+		insertFree(AllocatorEntry::build(first->getNext(), (byte *)end - (byte *)first->getNext(), false));
+
+		for (qword i = 0; i < arena->linkCount; i++)
+		{
+			ArenaLink *&bucket = getArenaBucket((qword)address + (i << arenaGranuleShift));
+			arena->links[i] = ArenaLink{arena, bucket};
+			bucket = &arena->links[i];
+		}
+
+		arena->next = arenas;
+		arenas = arena;
+		heapSize += arena->areaSize;
+		return true;
+	}
+	bool Heap::grow(qword allocationSize, ull alignment)
+	{
+		if (!requestMemory)
+			return false;
+
+		// room for the block and for the bookkeeping of the new arena
+		qword size = alignValueUpwards(allocationSize, 0x10) + alignment + AllocatorEntry::minBlockSize * 2;
+		size += sizeof(Arena) + size / slabPageSize + ((size >> arenaGranuleShift) + 2) * sizeof(ArenaLink) + 0x40;
+		void *address = requestMemory(size);
+		if (!address)
+			return false;
+		if (!addArena(address, size))
+		{
+			if (releaseMemory)
+				releaseMemory(address, size);
+			return false;
+		}
+		return true;
+	}
+	void Heap::releaseArena(Arena *arena)
+	{
+		Arena **link = &arenas;
+		while (*link != arena)
+			link = &(*link)->next;
+		*link = arena->next;
+		for (qword i = 0; i < arena->linkCount; i++)
+		{
+			ArenaLink **bucketLink = &getArenaBucket((qword)arena + (i << arenaGranuleShift));
+			while (*bucketLink != &arena->links[i])
+				bucketLink = &(*bucketLink)->next;
+			*bucketLink = arena->links[i].next;
+		}
+		if (emptyArena == arena)
+			emptyArena = nullptr;
+
+		removeFree(arena->first()->getNext());
+		heapSize -= arena->areaSize;
+		releaseMemory(arena, arena->length);
+	}
+
+	qword Heap::getEmptyArenaBytes() { return emptyArena && emptyArena->isEmpty() ? emptyArena->length : 0; }
+	qword Heap::releaseEmptyArena()
+	{
+		qword bytes = getEmptyArenaBytes();
+		if (bytes)
+			releaseArena(emptyArena);
+		emptyArena = nullptr;
+		return bytes;
+	}
+
+	void Heap::markSlabPages(Slab *slab, qword size, byte entry)
+	{
+		Arena *arena = getArena(slab);
+		qword firstPage = ((qword)slab >> 12) - ((qword)arena->areaStart >> 12);
+		for (qword i = 0; i < size / slabPageSize; i++)
+			arena->slabPageMap[firstPage + i] = entry;
+	}
+	void *Heap::AllocateFromSlab(byte sizeClass, qword site)
+	{
+		SlabCache &cache = slabCaches[sizeClass];
+		Slab *slab = cache.partialSlabs;
+		if (slab)
+			cache.statistics.hits++;
+		else
+		{
+			if (cache.emptySlab)
+			{
+				// reuse the cached empty slab
+				cache.statistics.hits++;
+				slab = cache.emptySlab;
+				cache.emptySlab = nullptr;
+			}
+			else
+			{
+				// carve a new slab out of the heap, aligned to its size so objects can find it
+				cache.statistics.misses++;
+				qword size = SlabCache::slabSize(sizeClass),
+					  objectSize = SlabCache::objectSize(sizeClass);
+				slab = (Slab *)AllocateBlock(size, size);
+				if (!slab)
+					return nullptr;
+
+				slab->usedCount = 0;
+				slab->capacity = (size - SlabCache::firstObjectOffset(sizeClass, profiled)) / objectSize;
+				slab->freeList = nullptr;
+				byte *obj = (byte *)slab + size - objectSize;
+				for (word i = 0; i < slab->capacity; i++, obj -= objectSize)
+				{
+					*(void **)obj = slab->freeList;
+					slab->freeList = obj;
+				}
+				markSlabPages(slab, size, sizeClass + 1);
+				cache.statistics.slabCount++;
+			}
+			cache.linkPartial(slab);
+		}
+
+		void *obj = slab->freeList;
+		slab->freeList = *(void **)obj;
+		slab->usedCount++;
+		if (slab->isFull())
+			cache.unlinkPartial(slab);
+		cache.statistics.liveObjects++;
+		setObjectSite(obj, sizeClass, site);
+		return obj;
+	}
+	void Heap::DeallocateFromSlab(void *ptr, byte sizeClass)
+	{
+		SlabCache &cache = slabCaches[sizeClass];
+		qword size = SlabCache::slabSize(sizeClass);
+		Slab *slab = (Slab *)((qword)ptr & ~(size - 1));
+
+		if (profiled)
+			recordDeallocation(slab->sites[((byte *)ptr - (byte *)slab) / SlabCache::objectSize(sizeClass)], SlabCache::objectSize(sizeClass));
+		bool wasFull = slab->isFull();
+		*(void **)ptr = slab->freeList;
+		slab->freeList = ptr;
+		slab->usedCount--;
+		cache.statistics.liveObjects--;
+
+		if (slab->isEmpty())
+		{
+			if (!wasFull)
+				cache.unlinkPartial(slab);
+			if (cache.emptySlab)
+			{
+				// already holding an empty slab, give this one back to the heap
+				markSlabPages(slab, size, 0);
+				DeallocateBlock(slab);
+				cache.statistics.slabCount--;
+			}
+			else
+				cache.emptySlab = slab;
+		}
+		else if (wasFull)
+			cache.linkPartial(slab);
+	}
+
+	void Heap::setObjectSite(void *ptr, byte sizeClass, qword site)
+	{
+		if (!profiled)
+			return;
+		Slab *slab = (Slab *)((qword)ptr & ~(SlabCache::slabSize(sizeClass) - 1));
+		slab->sites[((byte *)ptr - (byte *)slab) / SlabCache::objectSize(sizeClass)] = packSite(site);
+		if (site)
+			recordAllocation(site, SlabCache::objectSize(sizeClass));
+	}
+	void *Heap::AllocateFromMagazine(byte sizeClass, qword site)
+	{
+		byte cpu;
+		qword state = enterCPU(cpu);
+		CPUMagazines &local = cpuMagazines[cpu][sizeClass];
+		Depot &depot = depots[sizeClass];
+		if ((!local.loaded || local.loaded->isEmpty()) && local.previous && !local.previous->isEmpty())
+		{
+			Magazine *magazine = local.loaded;
+			local.loaded = local.previous;
+			local.previous = magazine;
+		}
+		if ((!local.loaded || local.loaded->isEmpty()) && depot.full)
+		{
+			// both are empty: the previous one goes to the depot, and a full one from there is loaded
+			if (local.previous)
+				push(depot.empty, local.previous);
+			local.previous = local.loaded;
+			local.loaded = pop(depot.full);
 		}
 
-		// try before the first
-		alignedStart = heapStart();
-		if (fitsAllocation(alignedStart, firstAllocation, allocationSize, alignment))
+		void *obj = nullptr;
+		if (local.loaded && !local.loaded->isEmpty())
 		{
-			AllocatorEntry *obj = AllocatorEntry::build(alignedStart, allocationSize, nullptr, firstAllocation);
-			firstAllocation->prevAllocation = obj;
-			firstAllocation = obj;
-			return obj->getAllocatedBlock();
+			obj = local.loaded->rounds[--local.loaded->count];
+			magazineRounds--;
+			magazineStatistics[sizeClass].hits++;
+			setObjectSite(obj, sizeClass, site);
+		}
+		else
+			magazineStatistics[sizeClass].misses++;
+		leaveCPU(state);
+		return obj;
+	}
+	bool Heap::DeallocateToMagazine(void *ptr, byte sizeClass)
+	{
+		byte cpu;
+		qword state = enterCPU(cpu);
+		CPUMagazines &local = cpuMagazines[cpu][sizeClass];
+		Depot &depot = depots[sizeClass];
+		if ((!local.loaded || local.loaded->isFull()) && local.previous && !local.previous->isFull())
+		{
+			Magazine *magazine = local.loaded;
+			local.loaded = local.previous;
+			local.previous = magazine;
+		}
+		if (!local.loaded || local.loaded->isFull())
+		{
+			// both are full: the previous one goes to the depot, and an empty one is loaded
+			Magazine *empty = pop(depot.empty);
+			if (!empty)
+			{
+				// magazines come straight from the slabs, going through the magazines would recurse
+				byte magazineClass;
+				getSlabClass(sizeof(Magazine), 0x10, magazineClass);
+				empty = (Magazine *)AllocateFromSlab(magazineClass, 0);
+				if (empty)
+				{
+					empty->count = 0;
+					magazineCount++;
+				}
+			}
+			if (empty)
+			{
+				if (local.previous)
+					push(depot.full, local.previous);
+				local.previous = local.loaded;
+				local.loaded = empty;
+			}
 		}
 
-		// try inbetween all the entries
-		for (AllocatorEntry *i = firstAllocation; i != lastAllocation; i = i->nextAllocation)
+		bool kept = local.loaded && !local.loaded->isFull();
+		if (kept)
 		{
-			alignedStart = i->getSpaceAfter();
-			if (fitsAllocation(alignedStart, i->nextAllocation, allocationSize, alignment))
+			if (profiled)
 			{
-				AllocatorEntry *obj = AllocatorEntry::build(alignedStart, allocationSize, i, i->nextAllocation);
-				i->nextAllocation = obj;
-				obj->nextAllocation->prevAllocation = obj;
-				return obj->getAllocatedBlock();
+				Slab *slab = (Slab *)((qword)ptr & ~(SlabCache::slabSize(sizeClass) - 1));
+				recordDeallocation(slab->sites[((byte *)ptr - (byte *)slab) / SlabCache::objectSize(sizeClass)], SlabCache::objectSize(sizeClass));
 			}
+			local.loaded->rounds[local.loaded->count++] = ptr;
+			magazineRounds++;
 		}
+		leaveCPU(state);
+		return kept;
+	}
+	qword Heap::getDepotBytes()
+	{
+		qword bytes = 0;
+		for (byte c = 0; c < slabClassCount; c++)
+			for (Magazine *magazine = depots[c].full; magazine; magazine = magazine->next)
+				bytes += magazine->count * SlabCache::objectSize(c);
+		return bytes;
+	}
+	qword Heap::drainDepot(qword bytes)
+	{
+		// the magazines loaded on a cpu are only for that cpu to touch
+		byte magazineClass;
+		getSlabClass(sizeof(Magazine), 0x10, magazineClass);
+		qword freed = 0;
+		for (byte c = 0; c < slabClassCount && freed < bytes; c++)
+		{
+			Depot &depot = depots[c];
+			while (depot.full && freed < bytes)
+			{
+				Magazine *magazine = pop(depot.full);
+				while (!magazine->isEmpty())
+				{
+					// the deallocation was recorded when the object went into the magazine
+					void *obj = magazine->rounds[--magazine->count];
+					setObjectSite(obj, c, 0);
+					DeallocateFromSlab(obj, c);
+					magazineRounds--;
+					freed += SlabCache::objectSize(c);
+				}
+				push(depot.empty, magazine);
+			}
+		}
+		// empty magazines are only worth keeping while there is no shortage
+		for (byte c = 0; c < slabClassCount; c++)
+			while (depots[c].empty)
+			{
+				DeallocateFromSlab(pop(depots[c].empty), magazineClass);
+				magazineCount--;
+				freed += SlabCache::objectSize(magazineClass);
+			}
+		return freed;
+	}
 
-		// try after the last, if there is no space, return nullptr
-		alignedStart = lastAllocation->getSpaceAfter();
-		if (fitsAllocation(alignedStart, (byte *)heapStart() + heapSize, allocationSize, alignment))
+	void *Heap::AllocateUnlocked(qword allocationSize, ull alignment, qword site)
+	{
+		byte sizeClass;
+		bool slabClass = getSlabClass(allocationSize, alignment, sizeClass), reclaimed = false;
+		if (slabClass && enterCPU)
+		{
+			void *obj = AllocateFromMagazine(sizeClass, site);
+			if (obj)
+				return obj;
+		}
+		if (allocationSize >= largeObjectThreshold && alignment <= 0x1000 && requestPages)
 		{
-			AllocatorEntry *obj = AllocatorEntry::build(alignedStart, allocationSize, lastAllocation, nullptr);
-			lastAllocation->nextAllocation = obj;
-			lastAllocation = obj;
-			return obj->getAllocatedBlock();
+			void *obj = AllocateLarge(allocationSize, site);
+			if (!obj && reclaimMemory && reclaimMemory(allocationSize))
+				obj = AllocateLarge(allocationSize, site);
+			if (obj)
+				return obj;
+			// a free block of the arenas might still be big enough
+			reclaimed = true;
 		}
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			if (slabClass)
+			{
+				void *obj = AllocateFromSlab(sizeClass, site);
+				if (obj)
+					return obj;
+				// no room for a new slab, the general heap might still have a gap that fits
+			}
+
+			void *block = AllocateBlock(allocationSize, alignment);
+			if (block)
+			{
+				if (site)
+				{
+					AllocatorEntry *entry = AllocatorEntry::fromAllocatedBlock(block);
+					entry->reserved = packSite(site);
+					recordAllocation(site, entry->getAllocatedSize());
+				}
+				return block;
+			}
 
+			// a new slab needs more than the object itself
+			qword requiredSize = slabClass ? SlabCache::slabSize(sizeClass) : allocationSize;
+			ull requiredAlignment = slabClass ? SlabCache::slabSize(sizeClass) : alignment;
+			if (grow(requiredSize, requiredAlignment))
+				continue;
+			// before memory is declared full, the caches of the owner get to give some of it back
+			if (reclaimed || !reclaimMemory || !reclaimMemory(requiredSize))
+				break;
+			reclaimed = true;
+			attempt--;
+		}
 		cout << "Warning: Memory full!\n";
 		return nullptr;
 	}
+	Heap::AllocatorEntry *Heap::findFree(qword blockSize)
+	{
+		// every block in a list above the one of blockSize is big enough
+		byte index = getFreeListIndex(blockSize);
+		ull biggerLists = index == freeListCount - 1 ? 0 : freeListMap & ~(((ull)2 << index) - 1);
+		if (biggerLists)
+			return freeLists[__builtin_ctzll(biggerLists)];
+
+		// otherwise, look for a fit in the list of blockSize
+		for (AllocatorEntry *entry = freeLists[index]; entry; entry = entry->nextFree)
+			if (entry->getBlockSize() >= blockSize)
+				return entry;
+		return nullptr;
+	}
+	void *Heap::AllocateBlock(qword allocationSize, ull alignment)
+	{
+		// blocks are always aligned to 0x10
+		if (alignment < 0x10)
+			alignment = 0x10;
+		qword blockSize = alignValueUpwards(allocationSize ? allocationSize : 1, 0x10) + AllocatorEntry::maintenanceSize;
+		if (blockSize < AllocatorEntry::minBlockSize)
+			blockSize = AllocatorEntry::minBlockSize;
+
+		// with a bigger alignment, leave room for a free block in front of the aligned one
+		qword searchSize = alignment == 0x10 ? blockSize : blockSize + alignment + AllocatorEntry::minBlockSize;
+		AllocatorEntry *entry = findFree(searchSize);
+		if (!entry)
+			return nullptr;
+		removeFree(entry);
+		qword available = entry->getBlockSize();
+
+		if (alignment != 0x10)
+		{
+			qword gap = alignValueUpwards((ull)entry->getAllocatedBlock(), alignment) - (ull)entry->getAllocatedBlock();
+			if (gap && gap < AllocatorEntry::minBlockSize)
+				gap += alignment;
+			if (gap)
+			{
+				insertFree(AllocatorEntry::build(entry, gap, false));
+				entry = (AllocatorEntry *)((byte *)entry + gap);
+				available -= gap;
+			}
+		}
+
+		// give back what is left after the block, if it is big enough to be used
+		if (available - blockSize >= AllocatorEntry::minBlockSize)
+			insertFree(AllocatorEntry::build((byte *)entry + blockSize, available - blockSize, false));
+		else
+			blockSize = available;
+
+		AllocatorEntry::build(entry, blockSize, true);
+		blockCount++;
+		return entry->getAllocatedBlock();
+	}
+	void *Heap::AllocateLarge(qword allocationSize, qword site)
+	{
+		if (!freeLargeObjects)
+		{
+			LargeObject *records = (LargeObject *)requestPages(0x1000);
+			if (!records)
+				return nullptr;
+			for (qword i = 0; i < 0x1000 / sizeof(LargeObject); i++)
+			{
+				records[i].next = freeLargeObjects;
+				freeLargeObjects = &records[i];
+			}
+		}
+		qword length = alignValueUpwards(allocationSize, 0x1000);
+		void *address = requestPages(length);
+		if (!address)
+			return nullptr;
+
+		LargeObject *object = freeLargeObjects;
+		freeLargeObjects = object->next;
+		LargeObject *&bucket = getLargeObjectBucket(address);
+		*object = LargeObject{bucket, address, length, packSite(site)};
+		bucket = object;
+		largeObjectCount++;
+		if (site)
+			recordAllocation(site, length);
+		return address;
+	}
+	void Heap::DeallocateLarge(void *ptr)
+	{
+		LargeObject **link = &getLargeObjectBucket(ptr);
+		while (*link && (*link)->address != ptr)
+			link = &(*link)->next;
+		LargeObject *object = *link;
+		if (!object)
+		{
+			cout << "Attempted to deallocate " << ptr << ", which is not part of the heap\n";
+			return;
+		}
+
+		*link = object->next;
+		largeObjectCount--;
+		recordDeallocation(object->site, object->length);
+		releasePages(object->address, object->length);
+		object->next = freeLargeObjects;
+		freeLargeObjects = object;
+	}
+	void Heap::DeallocateBlock(void *ptr)
+	{
+		if (!ptr)
+			return;
+		AllocatorEntry *entry = AllocatorEntry::fromAllocatedBlock(ptr);
+		if (!entry->isAllocated() || entry->Corrupted())
+		{
+			entry->CorruptionDetected();
+			return;
+		}
+		blockCount--;
+		recordDeallocation(entry->reserved, entry->getAllocatedSize());
+
+		// merge with the free neighbours right away, so that free blocks are never adjacent
+		qword blockSize = entry->getBlockSize();
+		AllocatorEntry *next = entry->getNext();
+		if (!next->isAllocated())
+		{
+			removeFree(next);
+			blockSize += next->getBlockSize();
+		}
+		if (!entry->isPrevAllocated())
+		{
+			AllocatorEntry *prev = entry->getPrev();
+			removeFree(prev);
+			blockSize += prev->getBlockSize();
+			entry = prev;
+		}
+		insertFree(AllocatorEntry::build(entry, blockSize, false));
+
+		// give back arenas that became completely free, except the one holding the heap itself;
+		// one of them is kept, so that a heap that shrinks and grows again does not go to releaseMemory every time
+		if (releaseMemory && entry->getNext()->isEnd())
+		{
+			Arena *arena = getArena(entry);
+			if (entry->getPrev() == arena->first() && (void *)arena != (void *)(this + 1))
+			{
+				if (emptyArena && emptyArena != arena && emptyArena->isEmpty())
+					releaseArena(arena);
+				else
+					emptyArena = arena;
+			}
+		}
+	}
 }
 
-void *malloc(ull size) { return Memory::Heap::AllocateFromSelected(size, 0x10); }
+void *Memory::Allocate(ull size, ull alignment) { return Memory::Heap::AllocateFromSelected(size, alignment, (qword)__builtin_return_address(0)); }
+
+void *malloc(ull size) { return Memory::Heap::AllocateFromSelected(size, 0x10, (qword)__builtin_return_address(0)); }
 void *calloc(ull size)
 {
-	int *ptr = (int *)Memory::Heap::AllocateFromSelected(size, 0x10);
-	size >>= 2;
-	for (ull i = 0; i < size; i++)
-		ptr[i] = 0;
+	void *ptr = Memory::Heap::AllocateFromSelected(size, 0x10, (qword)__builtin_return_address(0));
+	if (ptr == nullptr)
+		return nullptr;
+	// rep stosb stores whole cache lines at once on cpus with fast strings
+	void *dest = ptr;
+	asm volatile(
+		"cld\n"
+		"rep stosb"
+		: "+D"(dest), "+c"(size)
+		: "a"(0)
+		: "memory");
 	return ptr;
 }
 void free(void *block) { Memory::Heap::DeallocateFromSelected(block); }
 
-void *operator new(size_t size) { return Memory::Heap::AllocateFromSelected(size, 0x10); }
-void *operator new[](size_t size) { return Memory::Heap::AllocateFromSelected(size, 0x10); }
+void *operator new(size_t size) { return Memory::Heap::AllocateFromSelected(size, 0x10, (qword)__builtin_return_address(0)); }
+void *operator new[](size_t size) { return Memory::Heap::AllocateFromSelected(size, 0x10, (qword)__builtin_return_address(0)); }
 void operator delete(void *ptr) { Memory::Heap::DeallocateFromSelected(ptr); }
 void operator delete(void *ptr, size_t size) { Memory::Heap::DeallocateFromSelected(ptr, size); }
 void operator delete[](void *ptr) { Memory::Heap::DeallocateFromSelected(ptr); }
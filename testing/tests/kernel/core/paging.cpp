@@ -1,5 +1,6 @@
 // include tested file
 #include <core/paging.cpp>
+#include <core/pageframe.cpp>
 
 // include libs
 #include <mem.h>
@@ -504,6 +505,73 @@ TEST(mapRegion_expansionAndCollapse)
 	TEST_END;
 }
 
+TEST(shareKernelHalf)
+{
+	TEST_INIT;
+
+	DEFINE_TESTCASES
+	(
+		INPUTLIST
+		{
+			// mapped in the kernel pml4 before sharing
+			qword kernelVirtualAddress;
+			qword kernelPhysicalAddress;
+			qword kernelLen;
+			// mapped in the kernel pml4 after sharing
+			qword laterVirtualAddress;
+			qword laterPhysicalAddress;
+			// mapped in the task pml4 only
+			qword userVirtualAddress;
+			qword userPhysicalAddress;
+		},
+		OUTPUTLIST
+		{
+		}
+	)
+	TESTCASELIST
+	{
+		/* Test case 0 */ {{ 0xffffffff80000000, 0x0000000000000, 0x00000080000, 0xffffffff80081000, 0x0000005431000, 0x0000000100000, 0x0000002000000 }, {}}, // kernel image and a later interrupt stack
+		/* Test case 1 */ {{ 0xffffff8000000000, 0x0000040000000, 0x00000400000, 0xffffffffc0000000, 0x0000001234000, 0x00007f0000000000, 0x0000003000000 }, {}}, // 2mb pages, later mapping in another pdpt entry
+	};
+
+	FOREACH_TESTCASE
+	{
+		void* pageSpace = (void*)heapStart;
+		dword pageAllocationMap = 0xffff0000;
+
+		PageMapLevel4 *kernel = PageMapLevel4::create(pageSpace, pageAllocationMap);
+		PageMapLevel4 *task = PageMapLevel4::create(pageSpace, pageAllocationMap);
+		test_assert_expected_named(kernel, !=, nullptr);
+		test_assert_expected_named(task, !=, nullptr);
+		if (kernel == nullptr || task == nullptr)
+			continue;
+
+		test_assert(kernel->mapRegion(pageSpace, pageAllocationMap, INPUT(kernelVirtualAddress), INPUT(kernelPhysicalAddress), INPUT(kernelLen), PageEntry::EntryAttributes(PageEntry::writeAccessBit)));
+		task->shareKernelHalf(*kernel);
+		test_assert(kernel->mapRegion(pageSpace, pageAllocationMap, INPUT(laterVirtualAddress), INPUT(laterPhysicalAddress), 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit)));
+		test_assert(task->mapRegion(pageSpace, pageAllocationMap, INPUT(userVirtualAddress), INPUT(userPhysicalAddress), 0x1000, PageEntry::EntryAttributes(PageEntry::writeAccessBit | PageEntry::userPageBit)));
+
+		// kernel mappings are visible in the task, even the ones made after sharing, but task mappings stay private
+		qword physicalAddress;
+		test_assert(task->getPhysicalAddress(INPUT(kernelVirtualAddress), physicalAddress) && physicalAddress == INPUT(kernelPhysicalAddress));
+		test_assert(task->getPhysicalAddress(INPUT(laterVirtualAddress), physicalAddress) && physicalAddress == INPUT(laterPhysicalAddress));
+		test_assert(!task->getPhysicalAddress(INPUT(kernelVirtualAddress), physicalAddress, true));
+		test_assert(!kernel->getPhysicalAddress(INPUT(userVirtualAddress), physicalAddress));
+
+		// destroying the task must leave the kernel tables alone
+		task->unshareKernelHalf();
+		task->clearAll(pageSpace, pageAllocationMap);
+		DeallocatePage(pageSpace, pageAllocationMap, task);
+		test_assert(kernel->getPhysicalAddress(INPUT(kernelVirtualAddress), physicalAddress) && physicalAddress == INPUT(kernelPhysicalAddress));
+		test_assert(kernel->getPhysicalAddress(INPUT(laterVirtualAddress), physicalAddress) && physicalAddress == INPUT(laterPhysicalAddress));
+
+		kernel->clearAll(pageSpace, pageAllocationMap);
+		test_assert_expected_hex(pageAllocationMap, ==, 0xffff0001);
+	}
+
+	TEST_END;
+}
+
 #include "test_libc_stub.h"
 
 extern "C" void main()
@@ -517,6 +585,7 @@ extern "C" void main()
 		MAKETEST(getPhysicalAddress),
 		MAKETEST(mapRegion),
 		MAKETEST(mapRegion_expansionAndCollapse),
+		MAKETEST(shareKernelHalf),
 	};
 
 	EXECUTE_ALL_TESTS;